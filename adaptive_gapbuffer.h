@@ -0,0 +1,226 @@
+#ifndef ADAPTIVE_GAPBUFFER_H
+#define ADAPTIVE_GAPBUFFER_H
+
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Tuning for BasicAdaptiveGapbuffer. Distances and sizes are in values
+struct GapbufferAdaptive {
+    std::size_t history = 16;        // Recent edit positions remembered
+    std::size_t hot = 2;             // Recent edits near the gap that make it worth keeping there
+    std::size_t near = 4 * 1024;     // Edits this close to the gap are made at once
+    std::size_t max_deferred = 256;  // Largest edit, values erased plus inserted, that is deferred
+    std::size_t max_pending = 64;    // Deferred edits held before they are applied in one sweep
+};
+
+// Gap buffer taking edits at any position, for workloads that alternate between a few hot spots
+// such as the insertion point and a log tail, where moving the gap for every switch would drag
+// it the full distance each time. The positions of recent edits decide what happens to each one:
+// - close to the gap, it is made there
+// - small and far from a gap that recent edits keep coming back to, it is deferred, and the
+//   deferred edits are applied later in a single apply_batch() sweep
+// - otherwise the gap is relocated to it, applying anything deferred on the way
+// Reading goes through buffer(), which applies whatever is deferred first
+template <
+    typename CharT,
+    typename Allocator = std::allocator<CharT>,
+    typename Growth = GapbufferGrowth<>>
+class BasicAdaptiveGapbuffer {
+   public:
+    // member types
+    using buffer_type = BasicGapbuffer<CharT, Allocator, Growth>;
+    using value_type = CharT;
+    using allocator_type = Allocator;
+    using size_type = typename buffer_type::size_type;
+    using difference_type = typename buffer_type::difference_type;
+    using string_view_type = typename buffer_type::string_view_type;
+
+    // Constructors
+    BasicAdaptiveGapbuffer() : BasicAdaptiveGapbuffer(buffer_type()) {}
+
+    explicit BasicAdaptiveGapbuffer(buffer_type initial, GapbufferAdaptive tuning = {})
+        : buf(std::move(initial)), options(tuning), length(buf.size()) {
+        recent.reserve(options.history);
+    }
+
+    // Size including deferred edits
+    [[nodiscard]] size_type size() const noexcept { return length; }
+
+    [[nodiscard]] bool empty() const noexcept { return length == 0; }
+
+    // Number of edits deferred and not yet applied to buffer()
+    [[nodiscard]] size_type pending() const noexcept { return deferred.size(); }
+
+    // The contents, with every deferred edit applied
+    [[nodiscard]] buffer_type& buffer() {
+        flush();
+        return buf;
+    }
+
+    // Replace `erase_count` values starting at `pos` with `text`
+    void edit(size_type pos, size_type erase_count, string_view_type text) {
+        if (pos > length || erase_count > length - pos) {
+            throw std::out_of_range("Cannot edit past the end of the buffer");
+        }
+        if (erase_count == 0 && text.empty()) {
+            return;
+        }
+
+        // Edits that touch deferred ones are not merged with them, the deferred ones are
+        // applied first instead
+        Mapped at = map(pos, erase_count);
+        if (at.overlaps) {
+            flush();
+            at = map(pos, erase_count);
+        }
+
+        const size_type target = at.pos + erase_count;
+        const size_type gap = buf.pos();
+        const size_type distance = target < gap ? gap - target : target - gap;
+        const bool keep_gap = gap_is_hot();
+        remember(pos);
+
+        if (distance <= options.near) {
+            // Cheap to reach, so made at once. Deferred edits after it now start elsewhere
+            buf.move_gap_to(target);
+            buf.erase(erase_count);
+            buf.insert(text);
+            for (auto it = deferred.begin() + at.index; it != deferred.end(); ++it) {
+                it->pos = it->pos + text.size() - erase_count;
+            }
+        } else if (keep_gap && erase_count + text.size() <= options.max_deferred) {
+            defer(at, erase_count, text);
+            if (deferred.size() > options.max_pending) {
+                flush();
+            }
+        } else {
+            // The gap moves here, and the sweep that takes it there applies everything else
+            defer(at, erase_count, text);
+            length += text.size() - erase_count;
+            apply(pos + text.size());
+            return;
+        }
+        length += text.size() - erase_count;
+    }
+
+    void insert(size_type pos, string_view_type text) { edit(pos, 0, text); }
+
+    void erase(size_type pos, size_type count) { edit(pos, count, string_view_type()); }
+
+    // Apply every deferred edit in one sweep, leaving the gap next to the values it was next to
+    void flush() {
+        if (!deferred.empty()) {
+            apply(gap_position());
+        }
+    }
+
+   private:
+    // A deferred edit. `pos` is an offset into buf, which does not have any of them applied
+    struct Pending {
+        size_type pos;
+        size_type erase_count;
+        std::vector<CharT> text;
+    };
+
+    // Where an edit at a position that counts deferred edits goes in buf and in `deferred`
+    struct Mapped {
+        size_type pos = 0;
+        size_type index = 0;    // First deferred edit after it
+        bool overlaps = false;  // It touches values inserted or erased by a deferred edit
+    };
+
+    Mapped map(size_type pos, size_type erase_count) const noexcept {
+        difference_type delta = 0;
+        for (size_type i = 0; i < deferred.size(); i++) {
+            const Pending& d = deferred[i];
+            const size_type start = d.pos + delta;
+            if (pos + erase_count <= start) {
+                return Mapped{pos - delta, i, false};
+            }
+            if (pos < start + d.text.size()) {
+                return Mapped{0, i, true};
+            }
+            delta += static_cast<difference_type>(d.text.size()) -
+                     static_cast<difference_type>(d.erase_count);
+        }
+        return Mapped{pos - delta, deferred.size(), false};
+    }
+
+    // Position of the gap counting deferred edits
+    [[nodiscard]] size_type gap_position() const noexcept {
+        const size_type gap = buf.pos();
+        difference_type delta = 0;
+        for (const Pending& d : deferred) {
+            if (d.pos + d.erase_count <= gap) {
+                delta += static_cast<difference_type>(d.text.size()) -
+                         static_cast<difference_type>(d.erase_count);
+            } else if (d.pos < gap) {
+                return d.pos + delta + d.text.size();
+            } else {
+                break;
+            }
+        }
+        return gap + delta;
+    }
+
+    // Whether enough recent edits were made near the gap for it to be worth leaving there
+    [[nodiscard]] bool gap_is_hot() const noexcept {
+        const size_type gap = gap_position();
+        const auto near_gap = std::count_if(recent.begin(), recent.end(), [&](size_type p) {
+            return (p < gap ? gap - p : p - gap) <= options.near;
+        });
+        return static_cast<std::size_t>(near_gap) >= options.hot;
+    }
+
+    void remember(size_type pos) {
+        if (options.history == 0) {
+            return;
+        }
+        if (recent.size() < options.history) {
+            recent.push_back(pos);
+        } else {
+            recent[nextRecent] = pos;
+        }
+        nextRecent = (nextRecent + 1) % options.history;
+    }
+
+    // Add an edit to the deferred ones. Typing onto the end of a deferred insertion extends it
+    void defer(const Mapped& at, size_type erase_count, string_view_type text) {
+        if (erase_count == 0 && at.index > 0) {
+            Pending& prev = deferred[at.index - 1];
+            if (prev.pos + prev.erase_count == at.pos) {
+                prev.text.insert(prev.text.end(), text.begin(), text.end());
+                return;
+            }
+        }
+        deferred.insert(deferred.begin() + at.index,
+                        Pending{at.pos, erase_count, std::vector<CharT>(text.begin(), text.end())});
+    }
+
+    // Apply the deferred edits with the gap left at `cursor`, an offset into the result
+    void apply(size_type cursor) {
+        std::vector<typename buffer_type::Edit> batch;
+        batch.reserve(deferred.size());
+        for (const Pending& d : deferred) {
+            batch.push_back({d.pos, d.erase_count, string_view_type(d.text.data(), d.text.size())});
+        }
+        buf.apply_batch(batch, cursor);
+        deferred.clear();
+    }
+
+    buffer_type buf;
+    GapbufferAdaptive options;
+    size_type length = 0;
+    std::vector<Pending> deferred;  // Sorted by position, none of them overlapping
+    std::vector<size_type> recent;  // Positions of the latest edits, oldest at nextRecent
+    std::size_t nextRecent = 0;
+};
+
+using AdaptiveGapbuffer = BasicAdaptiveGapbuffer<char>;
+
+#endif  // ADAPTIVE_GAPBUFFER_H
@@ -0,0 +1,341 @@
+// Side by side comparison of Gapbuffer with the other usual text containers over the operations
+// an editor performs. Linked into the same binary as bench_gapbuffer.cpp
+#include "chunked_gapbuffer.h"
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if __has_include(<ext/rope>)
+#include <ext/rope>
+#define BENCH_HAS_ROPE
+#endif
+
+#include <benchmark/benchmark.h>
+
+using CharVector = std::vector<char>;
+#ifdef BENCH_HAS_ROPE
+using Rope = __gnu_cxx::crope;
+#endif
+
+// Each container driven the way it is meant to be used
+template <typename Text>
+struct TextOps;
+
+template <>
+struct TextOps<Gapbuffer> {
+    // The cursor sits in the middle, so reads have to cross the gap
+    static Gapbuffer make(std::string_view text) {
+        auto buf = Gapbuffer(text);
+        buf.move_gap_to(text.size() / 2);
+        return buf;
+    }
+    static void append(Gapbuffer& t, std::string_view s) {
+        t.move_gap_to(t.size());
+        t.insert(s);
+    }
+    static void insert(Gapbuffer& t, std::size_t pos, std::string_view s) { t.insert(pos, s); }
+    static void erase(Gapbuffer& t, std::size_t pos, std::size_t n) {
+        t.move_gap_to(pos + n);
+        t.erase(n);
+    }
+    static char at(const Gapbuffer& t, std::size_t i) { return t[i]; }
+    static std::size_t find(const Gapbuffer& t, std::string_view s) { return t.find(s); }
+    static std::size_t line_count(const Gapbuffer& t) { return t.line_count(); }
+    static std::string line(const Gapbuffer& t, std::size_t pos) { return t.line(pos); }
+    static std::string to_str(const Gapbuffer& t) { return t.to_str(); }
+};
+
+template <>
+struct TextOps<ChunkedGapbuffer> {
+    static ChunkedGapbuffer make(std::string_view text) {
+        auto buf = ChunkedGapbuffer(text);
+        buf.move_gap_to(text.size() / 2);
+        return buf;
+    }
+    static void append(ChunkedGapbuffer& t, std::string_view s) { t.insert(t.size(), s); }
+    static void insert(ChunkedGapbuffer& t, std::size_t pos, std::string_view s) {
+        t.insert(pos, s);
+    }
+    static void erase(ChunkedGapbuffer& t, std::size_t pos, std::size_t n) {
+        t.move_gap_to(pos + n);
+        t.erase(n);
+    }
+    static char at(const ChunkedGapbuffer& t, std::size_t i) { return t[i]; }
+    static std::size_t find(const ChunkedGapbuffer& t, std::string_view s) { return t.find(s); }
+    static std::size_t line_count(const ChunkedGapbuffer& t) { return t.line_count(); }
+    static std::string line(const ChunkedGapbuffer& t, std::size_t pos) { return t.line(pos); }
+    static std::string to_str(const ChunkedGapbuffer& t) { return t.to_str(); }
+};
+
+// Shared by the two flat containers, which both hold the text contiguously
+template <typename Text>
+struct FlatTextOps {
+    static Text make(std::string_view text) { return Text(text.begin(), text.end()); }
+    static void append(Text& t, std::string_view s) { t.insert(t.end(), s.begin(), s.end()); }
+    static void insert(Text& t, std::size_t pos, std::string_view s) {
+        t.insert(t.begin() + pos, s.begin(), s.end());
+    }
+    static void erase(Text& t, std::size_t pos, std::size_t n) {
+        t.erase(t.begin() + pos, t.begin() + pos + n);
+    }
+    static char at(const Text& t, std::size_t i) { return t[i]; }
+    static std::size_t find(const Text& t, std::string_view s) { return view(t).find(s); }
+    static std::size_t line_count(const Text& t) {
+        return std::count(t.begin(), t.end(), '\n') + 1;
+    }
+    static std::string line(const Text& t, std::size_t pos) {
+        const std::string_view v = view(t);
+        const std::size_t first = pos == 0 ? 0 : v.rfind('\n', pos - 1) + 1;
+        const std::size_t newline = v.find('\n', pos);
+        return std::string(v.substr(first, newline == v.npos ? v.npos : newline + 1 - first));
+    }
+    static std::string to_str(const Text& t) { return std::string(view(t)); }
+
+   private:
+    static std::string_view view(const Text& t) { return std::string_view(t.data(), t.size()); }
+};
+
+template <>
+struct TextOps<std::string> : FlatTextOps<std::string> {};
+
+template <>
+struct TextOps<CharVector> : FlatTextOps<CharVector> {};
+
+#ifdef BENCH_HAS_ROPE
+template <>
+struct TextOps<Rope> {
+    static Rope make(std::string_view text) { return Rope(text.data(), text.size()); }
+    static void append(Rope& t, std::string_view s) { t.append(s.data(), s.size()); }
+    static void insert(Rope& t, std::size_t pos, std::string_view s) {
+        t.insert(pos, s.data(), s.size());
+    }
+    static void erase(Rope& t, std::size_t pos, std::size_t n) { t.erase(pos, n); }
+    static char at(const Rope& t, std::size_t i) { return t[i]; }
+    static std::size_t find(const Rope& t, std::string_view s) {
+        return t.find(std::string(s).c_str());
+    }
+    static std::size_t line_count(const Rope& t) {
+        return std::count(t.begin(), t.end(), '\n') + 1;
+    }
+    static std::string line(const Rope& t, std::size_t pos) {
+        std::size_t first = pos;
+        while (first > 0 && t[first - 1] != '\n') {
+            first--;
+        }
+        const std::size_t newline = t.find('\n', pos);
+        const std::size_t last = newline >= t.size() ? t.size() : newline + 1;
+        std::string ret(last - first, '\0');
+        t.copy(first, last - first, ret.data());
+        return ret;
+    }
+    static std::string to_str(const Rope& t) {
+        std::string ret(t.size(), '\0');
+        t.copy(0, t.size(), ret.data());
+        return ret;
+    }
+};
+#endif
+
+// Text with a newline every 64 values
+static std::string make_text(std::size_t len) {
+    std::string text(len, 'x');
+    for (std::size_t i = 63; i < len; i += 64) {
+        text[i] = '\n';
+    }
+    return text;
+}
+
+// Fixed seed so every container sees the same positions
+static std::vector<std::size_t> random_positions(std::size_t bound) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::size_t> dist(0, bound - 1);
+    std::vector<std::size_t> ret(4096);
+    std::generate(ret.begin(), ret.end(), [&] { return dist(rng); });
+    return ret;
+}
+
+// Typing at the end, 16 values at a time
+template <typename Text>
+static void BM_Append(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const std::string chunk(16, 'x');
+
+    for (auto _ : state) {
+        auto text = TextOps<Text>::make("");
+        for (std::size_t i = 0; i < len; i += chunk.size()) {
+            TextOps<Text>::append(text, chunk);
+        }
+        benchmark::DoNotOptimize(text);
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+// An insert and a delete of 8 values at unrelated positions, so the size stays the same
+template <typename Text>
+static void BM_RandomInsertErase(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto text = TextOps<Text>::make(make_text(len));
+    const auto positions = random_positions(len - 8);
+    const std::string_view value = "inserted";
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        TextOps<Text>::insert(text, positions[i % positions.size()], value);
+        TextOps<Text>::erase(text, positions[(i + 1) % positions.size()], value.size());
+        i += 2;
+    }
+    benchmark::DoNotOptimize(text);
+}
+
+template <typename Text>
+static void BM_RandomAccess(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+    const auto positions = random_positions(len);
+
+    for (auto _ : state) {
+        std::uint64_t sum = 0;
+        for (std::size_t pos : positions) {
+            sum += TextOps<Text>::at(text, pos);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * positions.size());
+}
+
+template <typename Text>
+static void BM_Iterate(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        std::uint64_t sum = 0;
+        for (char c : text) {
+            sum += c;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+// The needle is not there, so the whole text is searched
+template <typename Text>
+static void BM_Find(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(TextOps<Text>::find(text, "needle"));
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+template <typename Text>
+static void BM_Line(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+    const auto positions = random_positions(len);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(TextOps<Text>::line(text, positions[i++ % positions.size()]));
+    }
+}
+
+template <typename Text>
+static void BM_LineCount(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(TextOps<Text>::line_count(text));
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+template <typename Text>
+static void BM_ToStr(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(TextOps<Text>::to_str(text));
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+template <typename Text>
+static void BM_Copy(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        Text copy(text);
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+
+template <typename Text>
+static void BM_Move(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto text = TextOps<Text>::make(make_text(len));
+
+    for (auto _ : state) {
+        Text moved(std::move(text));
+        text = std::move(moved);
+        benchmark::DoNotOptimize(text);
+    }
+}
+
+// Moving the cursor back and forth by a given distance in a 64 MB buffer
+static void BM_GapDistance(benchmark::State& state) {
+    const auto distance = static_cast<std::size_t>(state.range(0));
+    constexpr std::size_t len = 64 << 20;
+    auto buf = TextOps<Gapbuffer>::make(make_text(len));
+    const std::size_t from = buf.pos();
+
+    for (auto _ : state) {
+        buf.move_gap_to(from + distance);
+        buf.move_gap_to(from);
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetBytesProcessed(state.iterations() * distance * 2);
+}
+BENCHMARK(BM_GapDistance)->RangeMultiplier(16)->Range(1, 16 << 20);
+
+// 1 KB up to 1 GB. Filter with --benchmark_filter to keep runs short
+static void sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(32)->Range(1 << 10, 1 << 30);
+}
+
+#ifdef BENCH_HAS_ROPE
+#define ROPE_BENCHMARK(fn) BENCHMARK_TEMPLATE(fn, Rope)->Apply(sizes)
+#else
+#define ROPE_BENCHMARK(fn) static_assert(true)
+#endif
+
+#define TEXT_BENCHMARK(fn)                                \
+    BENCHMARK_TEMPLATE(fn, Gapbuffer)->Apply(sizes);      \
+    BENCHMARK_TEMPLATE(fn, ChunkedGapbuffer)->Apply(sizes); \
+    BENCHMARK_TEMPLATE(fn, std::string)->Apply(sizes);    \
+    BENCHMARK_TEMPLATE(fn, CharVector)->Apply(sizes);     \
+    ROPE_BENCHMARK(fn)
+
+TEXT_BENCHMARK(BM_Append);
+TEXT_BENCHMARK(BM_RandomInsertErase);
+TEXT_BENCHMARK(BM_RandomAccess);
+TEXT_BENCHMARK(BM_Iterate);
+TEXT_BENCHMARK(BM_Find);
+TEXT_BENCHMARK(BM_Line);
+TEXT_BENCHMARK(BM_LineCount);
+TEXT_BENCHMARK(BM_ToStr);
+TEXT_BENCHMARK(BM_Copy);
+TEXT_BENCHMARK(BM_Move);
@@ -0,0 +1,661 @@
+#include "concurrent_gapbuffer.h"
+#include "gapbuffer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+static Gapbuffer make_buffer(std::size_t len) {
+    return Gapbuffer(std::string(len, 'x'));
+}
+
+// Walk the gap from the end of the buffer to the start and back one value at a time
+static void BM_AdvanceRetreatLoop(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto buf = make_buffer(len);
+
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < len; i++) {
+            buf.retreat();
+        }
+        for (std::size_t i = 0; i < len; i++) {
+            buf.advance();
+        }
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetBytesProcessed(state.iterations() * len * 2);
+}
+BENCHMARK(BM_AdvanceRetreatLoop)->RangeMultiplier(8)->Range(1 << 10, 200 << 10);
+
+// Same distance as above, relocated with one block move in each direction
+static void BM_MoveGapTo(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto buf = make_buffer(len);
+
+    for (auto _ : state) {
+        buf.move_gap_to(0);
+        buf.move_gap_to(len);
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetBytesProcessed(state.iterations() * len * 2);
+}
+BENCHMARK(BM_MoveGapTo)->RangeMultiplier(8)->Range(1 << 10, 200 << 10);
+
+// Paste a large block by pushing it one value at a time
+static void BM_InsertPushBackLoop(benchmark::State& state) {
+    const std::string payload(static_cast<std::size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        auto buf = Gapbuffer();
+        for (char c : payload) {
+            buf.push_back(c);
+        }
+        benchmark::DoNotOptimize(buf.size());
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_InsertPushBackLoop)->RangeMultiplier(16)->Range(1 << 10, 64 << 20);
+
+// Same paste through the bulk insert
+static void BM_InsertBulk(benchmark::State& state) {
+    const std::string payload(static_cast<std::size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        auto buf = Gapbuffer();
+        buf.insert(payload);
+        benchmark::DoNotOptimize(buf.size());
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_InsertBulk)->RangeMultiplier(16)->Range(1 << 10, 64 << 20);
+
+// Saving by joining the halves first, as callers had to before write_to(). Output goes to
+// /dev/null so only the cost on our side of the syscall is measured
+static void BM_SaveViaToStr(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto buf = make_buffer(len);
+    buf.move_gap_to(len / 2);
+    const int fd = ::open("/dev/null", O_WRONLY);
+
+    for (auto _ : state) {
+        const std::string str = buf.to_str();
+        benchmark::DoNotOptimize(::write(fd, str.data(), str.size()));
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_SaveViaToStr)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+static void BM_SaveWriteTo(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto buf = make_buffer(len);
+    buf.move_gap_to(len / 2);
+    const int fd = ::open("/dev/null", O_WRONLY);
+
+    for (auto _ : state) {
+        buf.write_to(fd);
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_SaveWriteTo)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Loading from a descriptor a pipe would give us, by collecting the input into a string first as
+// callers had to before read_from(), and then reading straight into the gap
+static int make_input_file(std::size_t len) {
+    char path[] = "/tmp/gapbuffer_bench_XXXXXX";
+    const int fd = ::mkstemp(path);
+    ::unlink(path);
+    const std::string text(len, 'x');
+    benchmark::DoNotOptimize(::write(fd, text.data(), text.size()));
+    return fd;
+}
+
+static void BM_LoadViaString(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const int fd = make_input_file(len);
+
+    for (auto _ : state) {
+        ::lseek(fd, 0, SEEK_SET);
+        std::string str;
+        char chunk[64 * 1024];
+        for (::ssize_t got; (got = ::read(fd, chunk, sizeof(chunk))) > 0;) {
+            str.append(chunk, static_cast<std::size_t>(got));
+        }
+        auto buf = Gapbuffer(str);
+        benchmark::DoNotOptimize(buf.size());
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_LoadViaString)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+static void BM_LoadReadFrom(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const int fd = make_input_file(len);
+
+    for (auto _ : state) {
+        ::lseek(fd, 0, SEEK_SET);
+        auto buf = Gapbuffer();
+        buf.read_from(fd);
+        benchmark::DoNotOptimize(buf.size());
+    }
+    ::close(fd);
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_LoadReadFrom)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Moving the gap across per-character attribute records, which are block moved like text, and
+// across strings, which have to be moved one assignment at a time
+struct Attribute {
+    std::uint32_t color;
+    std::uint16_t font;
+};
+
+template <typename T>
+static void BM_MoveGapValues(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const std::vector<T> values(len);
+    auto buf = BasicGapbuffer<T>(values.begin(), values.end());
+
+    for (auto _ : state) {
+        buf.move_gap_to(0);
+        buf.move_gap_to(len);
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetItemsProcessed(state.iterations() * len * 2);
+}
+BENCHMARK(BM_MoveGapValues<Attribute>)->RangeMultiplier(16)->Range(1 << 10, 16 << 20);
+BENCHMARK(BM_MoveGapValues<std::string>)->RangeMultiplier(16)->Range(1 << 10, 16 << 20);
+
+// Text with a newline roughly every 64 values, with the gap in the middle
+static Gapbuffer make_lines(std::size_t len) {
+    std::string text(len, 'x');
+    for (std::size_t i = 63; i < len; i += 64) {
+        text[i] = '\n';
+    }
+    auto buf = Gapbuffer(text);
+    buf.move_gap_to(len / 2);
+    return buf;
+}
+
+// What the status bar asks for on every keystroke, with and without the line index
+static void BM_StatusBarLookup(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    auto buf = make_lines(len);
+    if (state.range(1)) {
+        buf.enable_line_index();
+    }
+
+    for (auto _ : state) {
+        buf.push_back('y');
+        benchmark::DoNotOptimize(buf.line_count());
+        benchmark::DoNotOptimize(buf.line_of(buf.pos()));
+    }
+}
+BENCHMARK(BM_StatusBarLookup)
+    ->ArgNames({"len", "indexed"})
+    ->ArgsProduct({benchmark::CreateRange(1 << 10, 64 << 20, 16), {0, 1}});
+
+// Counting through the gap-skipping iterator, as line_count() used to
+static void BM_CountIterator(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::count(buf.begin(), buf.end(), '\n'));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_CountIterator)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Same call written unqualified, which finds the segmented overload through ADL
+static void BM_CountIteratorSegmented(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(count(buf.begin(), buf.end(), '\n'));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_CountIteratorSegmented)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+static void BM_CountSegments(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.count('\n'));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_CountSegments)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Last newline in the buffer, so every block has to be looked at
+static void BM_FindNth(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+    const std::size_t newlines = buf.count('\n');
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.find_nth('\n', newlines));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_FindNth)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// The two scans above split across every core. Below min_size these fall back to the serial path
+static void BM_CountParallel(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.count(gapbuffer_parallel, '\n'));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_CountParallel)->RangeMultiplier(16)->Range(1 << 10, 256 << 20)->UseRealTime();
+
+static void BM_FindNthParallel(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+    const std::size_t newlines = buf.count('\n');
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.find_nth(gapbuffer_parallel, '\n', newlines));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_FindNthParallel)->RangeMultiplier(16)->Range(1 << 10, 256 << 20)->UseRealTime();
+
+// One long line of mixed ASCII and two byte code points, like minified JSON, with the cursor
+// typing near its end
+static Gapbuffer make_long_line(std::size_t len) {
+    std::string text;
+    text.reserve(len);
+    while (text.size() + 2 <= len) {
+        text += (text.size() % 7 == 0) ? "\xC3\xA9" : "x";
+    }
+    auto buf = Gapbuffer(text);
+    buf.move_gap_to(buf.size() - buf.size() % 3 - 1);
+    return buf;
+}
+
+// One frame of a renderer fetching the 100 visible lines around the middle of the buffer, as
+// strings and as views
+static void BM_RenderLines(benchmark::State& state) {
+    auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+    buf.enable_line_index();
+    const std::size_t top = buf.line_count() / 2;
+
+    for (auto _ : state) {
+        std::size_t total = 0;
+        for (std::size_t i = top; i < top + 100; i++) {
+            total += buf.line(buf.line_start(i)).size();
+        }
+        benchmark::DoNotOptimize(total);
+    }
+}
+BENCHMARK(BM_RenderLines)->RangeMultiplier(16)->Range(64 << 10, 64 << 20);
+
+static void BM_RenderLineViews(benchmark::State& state) {
+    auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+    buf.enable_line_index();
+    const std::size_t top = buf.line_count() / 2;
+
+    for (auto _ : state) {
+        std::size_t total = 0;
+        for (const auto line : buf.lines(top, top + 100)) {
+            total += line.size();
+        }
+        benchmark::DoNotOptimize(total);
+    }
+}
+BENCHMARK(BM_RenderLineViews)->RangeMultiplier(16)->Range(64 << 10, 64 << 20);
+
+// How the editor finds the cursor column today, rescanning the line one byte at a time
+static void BM_ColumnRescan(benchmark::State& state) {
+    const auto buf = make_long_line(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        std::size_t column = 0;
+        for (std::size_t i = 0; i < buf.pos(); i++) {
+            column += (static_cast<unsigned char>(buf[i]) & 0xC0) != 0x80;
+        }
+        benchmark::DoNotOptimize(column);
+    }
+}
+BENCHMARK(BM_ColumnRescan)->RangeMultiplier(16)->Range(1 << 10, 64 << 20);
+
+static void BM_Column(benchmark::State& state) {
+    auto buf = make_long_line(static_cast<std::size_t>(state.range(0)));
+    if (state.range(1)) {
+        buf.enable_line_index();
+        buf.enable_codepoint_index();
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.column(buf.pos()));
+    }
+}
+BENCHMARK(BM_Column)
+    ->ArgNames({"len", "indexed"})
+    ->ArgsProduct({benchmark::CreateRange(1 << 10, 64 << 20, 16), {0, 1}});
+
+// Search and replace as callers do it today: copy out the whole text, then search the copy
+static void BM_FindSubstringViaToStr(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.to_str().find("needle"));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_FindSubstringViaToStr)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+static void BM_FindSubstring(benchmark::State& state) {
+    const auto buf = make_lines(static_cast<std::size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buf.find("needle"));
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_FindSubstring)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Classifying every value by index, as the syntax highlighter does
+static void BM_IndexLoop(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto buf = make_lines(len);
+
+    for (auto _ : state) {
+        std::size_t newlines = 0;
+        for (std::size_t i = 0; i < buf.size(); i++) {
+            newlines += buf[i] == '\n';
+        }
+        benchmark::DoNotOptimize(newlines);
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_IndexLoop)->RangeMultiplier(16)->Range(1 << 10, 16 << 20);
+
+// Same loop over the runs from data_at(), so the gap is only looked at once per run
+static void BM_DataAtRuns(benchmark::State& state) {
+    const auto len = static_cast<std::size_t>(state.range(0));
+    const auto buf = make_lines(len);
+
+    for (auto _ : state) {
+        std::size_t newlines = 0;
+        for (std::size_t pos = 0; pos < buf.size();) {
+            const auto run = buf.data_at(pos);
+            for (char c : run) {
+                newlines += c == '\n';
+            }
+            pos += run.size();
+        }
+        benchmark::DoNotOptimize(newlines);
+    }
+    state.SetBytesProcessed(state.iterations() * len);
+}
+BENCHMARK(BM_DataAtRuns)->RangeMultiplier(16)->Range(1 << 10, 16 << 20);
+
+// std::allocator that counts how often it is asked for memory
+template <typename T>
+struct CountingAllocator : std::allocator<T> {
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = CountingAllocator<U>;
+    };
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        allocations++;
+        return std::allocator<T>::allocate(n);
+    }
+
+    static inline std::size_t allocations = 0;
+};
+
+using CountingGapbuffer = BasicGapbuffer<char, CountingAllocator<char>>;
+
+// Short lived prompt sized buffers. Up to inline_capacity the contents never leave the object
+static void BM_TinyConstruct(benchmark::State& state) {
+    const std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+    CountingAllocator<char>::allocations = 0;
+
+    for (auto _ : state) {
+        auto buf = CountingGapbuffer(text);
+        buf.push_back('y');
+        benchmark::DoNotOptimize(buf.size());
+    }
+    state.counters["allocs_per_buffer"] = benchmark::Counter(
+        static_cast<double>(CountingAllocator<char>::allocations) /
+        static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_TinyConstruct)->Arg(0)->Arg(8)->Arg(16)->Arg(23)->Arg(24)->Arg(64);
+
+static void BM_TinyConstructString(benchmark::State& state) {
+    const std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        auto str = std::string(text);
+        str.push_back('y');
+        benchmark::DoNotOptimize(str.size());
+    }
+}
+BENCHMARK(BM_TinyConstructString)->Arg(0)->Arg(8)->Arg(16)->Arg(23)->Arg(24)->Arg(64);
+
+// Appending to a buffer list without reserving, so the vector reallocates and relocates every
+// buffer it holds as it grows
+static void BM_VectorGrowth(benchmark::State& state) {
+    const std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+    constexpr std::size_t count = 10'000;
+
+    std::vector<Gapbuffer> source;
+    std::vector<Gapbuffer> buffers;
+    for (auto _ : state) {
+        // Building and freeing the buffers is not what is measured
+        state.PauseTiming();
+        buffers = {};
+        source.clear();
+        for (std::size_t i = 0; i < count; i++) {
+            source.emplace_back(text);
+        }
+        state.ResumeTiming();
+
+        for (auto& buf : source) {
+            buffers.push_back(std::move(buf));
+        }
+        benchmark::DoNotOptimize(buffers.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_VectorGrowth)->Arg(16)->Arg(1 << 10)->Arg(64 << 10);
+
+// Reordering the buffer list, each step is a swap
+static void BM_VectorRotate(benchmark::State& state) {
+    const std::string text(static_cast<std::size_t>(state.range(0)), 'x');
+    std::vector<Gapbuffer> buffers(10'000, Gapbuffer(text));
+
+    for (auto _ : state) {
+        std::rotate(buffers.begin(), buffers.begin() + 1, buffers.end());
+        benchmark::DoNotOptimize(buffers.data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffers.size());
+}
+BENCHMARK(BM_VectorRotate)->Arg(16)->Arg(1 << 10)->Arg(64 << 10);
+
+// Typing a 64 value word one keystroke at a time, then deleting it again, in a 1 MB buffer.
+// With the journal enabled every keystroke is also recorded for undo
+static void BM_TypingJournal(benchmark::State& state) {
+    auto buf = make_lines(1 << 20);
+    if (state.range(0) != 0) {
+        buf.enable_undo();
+    }
+
+    for (auto _ : state) {
+        for (int i = 0; i < 64; i++) {
+            buf.push_back('a');
+        }
+        for (int i = 0; i < 64; i++) {
+            benchmark::DoNotOptimize(buf.pop_back());
+        }
+        buf.undo_boundary();
+    }
+    state.SetItemsProcessed(state.iterations() * 128);
+}
+BENCHMARK(BM_TypingJournal)->Arg(0)->Arg(1);
+
+// Undoing and redoing a typed paragraph of `range(0)` values
+static void BM_UndoRedo(benchmark::State& state) {
+    auto buf = make_lines(1 << 20);
+    buf.enable_undo();
+    for (int i = 0; i < state.range(0); i++) {
+        buf.push_back('a');
+    }
+
+    for (auto _ : state) {
+        buf.undo();
+        buf.redo();
+    }
+    benchmark::DoNotOptimize(buf.pos());
+}
+BENCHMARK(BM_UndoRedo)->Arg(16)->Arg(1024)->Arg(64 << 10);
+
+// Handing the text to a background reader, as autosave and the highlighter do, by copying it
+static void BM_ReaderCopy(benchmark::State& state) {
+    auto buf = make_lines(state.range(0));
+
+    for (auto _ : state) {
+        const auto copy = buf;
+        benchmark::DoNotOptimize(copy.size());
+        buf.push_back('a');
+        benchmark::DoNotOptimize(buf.pop_back());
+    }
+}
+BENCHMARK(BM_ReaderCopy)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// Same with a snapshot, editing on while it is alive
+static void BM_ReaderSnapshot(benchmark::State& state) {
+    auto buf = make_lines(state.range(0));
+
+    for (auto _ : state) {
+        const auto snap = buf.snapshot();
+        benchmark::DoNotOptimize(snap.size());
+        buf.push_back('a');
+        benchmark::DoNotOptimize(buf.pop_back());
+    }
+}
+BENCHMARK(BM_ReaderSnapshot)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+// A completed word typed at each of `cursors` evenly spaced positions in a 4 MB buffer. The
+// buffer has no room for it, so it has to grow
+static std::vector<Gapbuffer::Edit> multi_cursor_edits(std::size_t len, std::size_t cursors) {
+    std::vector<Gapbuffer::Edit> edits;
+    for (std::size_t i = 0; i < cursors; i++) {
+        edits.push_back({len / cursors * i, 0, "multi_cursor_word"});
+    }
+    return edits;
+}
+
+// Applying the edits one at a time, back to front so earlier positions stay valid
+static void BM_MultiCursorLoop(benchmark::State& state) {
+    const std::size_t len = 4 << 20;
+    const auto base = make_buffer(len);
+    const auto edits = multi_cursor_edits(len, state.range(0));
+    // Just after the last word, in the edited buffer
+    const std::size_t cursor = edits.back().pos + edits.size() * edits.back().text.size();
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto buf = base;
+        state.ResumeTiming();
+
+        for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+            buf.move_gap_to(it->pos + it->erase_count);
+            buf.erase(it->erase_count);
+            buf.insert(it->text);
+        }
+        buf.move_gap_to(cursor);
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetItemsProcessed(state.iterations() * edits.size());
+}
+BENCHMARK(BM_MultiCursorLoop)->RangeMultiplier(10)->Range(10, 100000);
+
+static void BM_MultiCursorBatch(benchmark::State& state) {
+    const std::size_t len = 4 << 20;
+    const auto base = make_buffer(len);
+    const auto edits = multi_cursor_edits(len, state.range(0));
+    // Just after the last word, in the edited buffer
+    const std::size_t cursor = edits.back().pos + edits.size() * edits.back().text.size();
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto buf = base;
+        state.ResumeTiming();
+
+        buf.apply_batch(edits, cursor);
+        benchmark::DoNotOptimize(buf.pos());
+    }
+    state.SetItemsProcessed(state.iterations() * edits.size());
+}
+BENCHMARK(BM_MultiCursorBatch)->RangeMultiplier(10)->Range(10, 100000);
+
+// Typing into a document shared with a thread that keeps reading lines from it, guarded by one
+// mutex as callers did before ConcurrentGapbuffer
+static void BM_SharedTypingMutex(benchmark::State& state) {
+    auto buf = Gapbuffer(std::string(static_cast<std::size_t>(state.range(0)), 'x') + "\n");
+    std::mutex mutex;
+    std::atomic<bool> done = false;
+    std::size_t reads = 0;
+    std::thread reader([&] {
+        for (; !done.load(); reads++) {
+            std::lock_guard lock(mutex);
+            benchmark::DoNotOptimize(buf.line(buf.size() / 2));
+        }
+    });
+
+    for (auto _ : state) {
+        std::lock_guard lock(mutex);
+        buf.push_back('a');
+    }
+    done = true;
+    reader.join();
+    state.counters["reads_per_edit"] = static_cast<double>(reads) / state.iterations();
+}
+BENCHMARK(BM_SharedTypingMutex)->Arg(1 << 10)->Arg(1 << 20)->UseRealTime();
+
+static void BM_SharedTypingConcurrent(benchmark::State& state) {
+    auto doc = ConcurrentGapbuffer(
+        Gapbuffer(std::string(static_cast<std::size_t>(state.range(0)), 'x') + "\n"));
+    std::atomic<bool> done = false;
+    std::size_t reads = 0;
+    std::thread reader([&] {
+        for (; !done.load(); reads++) {
+            const auto version = doc.current();
+            benchmark::DoNotOptimize(version->contents.line(version->contents.size() / 2));
+        }
+    });
+
+    std::size_t pos = 0;
+    for (auto _ : state) {
+        doc.insert(pos++, "a");
+    }
+    done = true;
+    reader.join();
+    state.counters["reads_per_edit"] = static_cast<double>(reads) / state.iterations();
+}
+BENCHMARK(BM_SharedTypingConcurrent)->Arg(1 << 10)->Arg(1 << 20)->UseRealTime();
+
+BENCHMARK_MAIN();
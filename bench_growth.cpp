@@ -0,0 +1,83 @@
+// How much growing a buffer costs and how many bytes it writes. Built into its own binary with
+// -DGAPBUFFER_STATS, so that the bytes come from stats() without every other benchmark being
+// timed with the counters compiled in
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#ifndef GAPBUFFER_STATS
+#error "bench_growth.cpp reads stats() and must be built with -DGAPBUFFER_STATS"
+#endif
+
+// Time one growth of the buffer `setup` returns and the bytes it wrote
+template <typename Setup>
+static void measure_growth(benchmark::State& state, Setup&& setup) {
+    double bytes_written = 0;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto buf = setup();
+        buf.reset_stats();
+        state.ResumeTiming();
+
+        buf.reserve(buf.capacity() * 2);
+        benchmark::DoNotOptimize(buf.capacity());
+        bytes_written += static_cast<double>(buf.stats().bytes_reallocated);
+    }
+    state.counters["bytes_written_per_growth"] =
+        bytes_written / static_cast<double>(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// One doubling of a full buffer. Only the existing values are written into the new allocation
+static void BM_ReserveGrowth(benchmark::State& state) {
+    const std::string payload(static_cast<std::size_t>(state.range(0)), 'x');
+    measure_growth(state, [&] { return Gapbuffer(payload); });
+}
+BENCHMARK(BM_ReserveGrowth)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+#ifdef GAPBUFFER_HAS_MREMAP
+// The same doubling once the storage is a huge page mapping, with the cursor in the middle:
+// the mapping is grown with mremap() and only the right half is moved
+static void BM_ReserveGrowthMapped(benchmark::State& state) {
+    using Paged = BasicGapbuffer<char, std::allocator<char>, GapbufferGrowth<8, 200, 0, 1 << 20>>;
+    const std::string payload(static_cast<std::size_t>(state.range(0)), 'x');
+    measure_growth(state, [&] {
+        auto buf = Paged(payload);
+        buf.reserve(buf.capacity() + 1);
+        buf.move_gap_to(buf.size() / 2);
+        return buf;
+    });
+}
+BENCHMARK(BM_ReserveGrowthMapped)->RangeMultiplier(16)->Range(1 << 20, 256 << 20);
+#endif
+
+// The previous growth strategy for comparison: value-initialize the whole new capacity, then
+// write the existing values over part of it. The bytes written are what the two calls report
+static void BM_ReserveGrowthValueInit(benchmark::State& state) {
+    const std::string payload(static_cast<std::size_t>(state.range(0)), 'x');
+    const std::size_t new_cap = (payload.size() + 8) * 2;
+    std::allocator<char> alloc;
+    double bytes_written = 0;
+
+    for (auto _ : state) {
+        char* mem = alloc.allocate(new_cap);
+        char* end = std::uninitialized_value_construct_n(mem, new_cap);
+        char* copied = std::copy(payload.begin(), payload.end(), mem);
+        benchmark::DoNotOptimize(end);
+        benchmark::ClobberMemory();
+        bytes_written += static_cast<double>((end - mem) + (copied - mem));
+        alloc.deallocate(mem, new_cap);
+    }
+    state.counters["bytes_written_per_growth"] =
+        bytes_written / static_cast<double>(state.iterations());
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_ReserveGrowthValueInit)->RangeMultiplier(16)->Range(1 << 10, 256 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,171 @@
+// Replays an edit log through Gapbuffer, moving the gap to every edit, and through
+// AdaptiveGapbuffer, to compare gap placement on real workloads. Linked into the same binary as
+// bench_gapbuffer.cpp. Set GAPBUFFER_TRACE to the path of a recorded log to replay it, otherwise
+// a synthetic log alternating between an insertion point and a log tail is used. With
+// -DGAPBUFFER_STATS the bytes moved and reallocated are reported as counters
+//
+// The log is plain text. The first line is `size <n>`, the size of the document before the
+// first edit, and every other line is one edit, `<pos> <erase_count> <insert_count>`, replacing
+// `erase_count` values at `pos` with as many inserted values. Lines starting with '#' are skipped
+#include "adaptive_gapbuffer.h"
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+struct TraceEdit {
+    std::size_t pos;
+    std::size_t erase_count;
+    std::size_t insert_count;
+};
+
+struct Trace {
+    std::size_t initial_size = 0;
+    std::vector<TraceEdit> edits;
+    std::size_t max_insert = 0;
+};
+
+static Trace load_trace(const char* path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error(std::string("Cannot open trace ") + path);
+    }
+
+    Trace ret;
+    std::size_t size = 0;
+    bool have_size = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        if (!have_size) {
+            std::string word;
+            if (!(fields >> word >> ret.initial_size) || word != "size") {
+                throw std::runtime_error("Trace must start with `size <n>`");
+            }
+            size = ret.initial_size;
+            have_size = true;
+            continue;
+        }
+
+        TraceEdit edit{};
+        if (!(fields >> edit.pos >> edit.erase_count >> edit.insert_count)) {
+            throw std::runtime_error("Malformed trace line: " + line);
+        }
+        if (edit.pos > size || edit.erase_count > size - edit.pos) {
+            throw std::runtime_error("Trace edit past the end of the document: " + line);
+        }
+        size = size - edit.erase_count + edit.insert_count;
+        ret.max_insert = std::max(ret.max_insert, edit.insert_count);
+        ret.edits.push_back(edit);
+    }
+    return ret;
+}
+
+// Typing and deleting at an insertion point a third of the way into an 8 MiB document, with a
+// line appended to its end every few edits and the insertion point moving now and then
+static Trace synthetic_trace() {
+    Trace ret;
+    ret.initial_size = 8 << 20;
+    std::size_t size = ret.initial_size;
+    std::size_t cursor = size / 3;
+    std::mt19937 rng(30);
+
+    for (int i = 0; i < 20000; i++) {
+        const unsigned roll = rng() % 100;
+        TraceEdit edit{};
+        if (roll < 20) {
+            edit = {size, 0, 40 + rng() % 80};
+        } else if (roll < 22) {
+            cursor = rng() % size;
+            continue;
+        } else if (roll < 35 && cursor > 0) {
+            edit = {cursor - 1, 1, 0};
+            cursor--;
+        } else {
+            edit = {cursor, 0, 1 + rng() % 3};
+            cursor += edit.insert_count;
+        }
+        size = size - edit.erase_count + edit.insert_count;
+        ret.max_insert = std::max(ret.max_insert, edit.insert_count);
+        ret.edits.push_back(edit);
+    }
+    return ret;
+}
+
+static const Trace& trace() {
+    static const Trace ret = [] {
+        const char* path = std::getenv("GAPBUFFER_TRACE");
+        return path != nullptr ? load_trace(path) : synthetic_trace();
+    }();
+    return ret;
+}
+
+// The gap is moved to every edit, as callers do today
+struct DirectReplay {
+    Gapbuffer buf;
+
+    explicit DirectReplay(std::size_t size) : buf(std::string(size, 'x')) {}
+
+    void edit(const TraceEdit& e, std::string_view text) {
+        buf.move_gap_to(e.pos + e.erase_count);
+        buf.erase(e.erase_count);
+        buf.insert(text);
+    }
+    Gapbuffer& finish() { return buf; }
+};
+
+struct AdaptiveReplay {
+    AdaptiveGapbuffer buf;
+
+    explicit AdaptiveReplay(std::size_t size) : buf(Gapbuffer(std::string(size, 'x'))) {}
+
+    void edit(const TraceEdit& e, std::string_view text) { buf.edit(e.pos, e.erase_count, text); }
+    Gapbuffer& finish() { return buf.buffer(); }
+};
+
+template <typename Replay>
+static void BM_TraceReplay(benchmark::State& state) {
+    const Trace& log = trace();
+    const std::string text(log.max_insert, 'y');
+#ifdef GAPBUFFER_STATS
+    double bytes_moved = 0;
+    double bytes_reallocated = 0;
+#endif
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Replay replay(log.initial_size);
+        state.ResumeTiming();
+
+        for (const TraceEdit& e : log.edits) {
+            replay.edit(e, std::string_view(text.data(), e.insert_count));
+        }
+        Gapbuffer& buf = replay.finish();
+        benchmark::DoNotOptimize(buf.size());
+#ifdef GAPBUFFER_STATS
+        bytes_moved += static_cast<double>(buf.stats().bytes_moved);
+        bytes_reallocated += static_cast<double>(buf.stats().bytes_reallocated);
+#endif
+    }
+    state.SetItemsProcessed(state.iterations() * log.edits.size());
+#ifdef GAPBUFFER_STATS
+    const double edits = static_cast<double>(state.iterations() * log.edits.size());
+    state.counters["bytes_moved_per_edit"] = bytes_moved / edits;
+    state.counters["bytes_reallocated_per_edit"] = bytes_reallocated / edits;
+#endif
+}
+BENCHMARK(BM_TraceReplay<DirectReplay>)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TraceReplay<AdaptiveReplay>)->Unit(benchmark::kMillisecond);
@@ -1,7 +1,9 @@
 #!/bin/bash
 
 function compile() {
-    clang++ -std=c++20 -Wall -Wextra -g catch_amalgamated.cpp test_gapbuffer.cpp -o gv_test
+    clang++ -std=c++20 -Wall -Wextra -g -pthread $CXXFLAGS catch_amalgamated.cpp test_gapbuffer.cpp \
+        test_chunked_gapbuffer.cpp test_concurrent_gapbuffer.cpp \
+        test_adaptive_gapbuffer.cpp -o gv_test
 
         # Only run tests if build is successful
         if [ $? -eq 0 ]; then
@@ -9,6 +11,18 @@ function compile() {
         fi
 }
 
+function bench() {
+    clang++ -std=c++20 -Wall -Wextra -O2 -march=native -DNDEBUG $CXXFLAGS \
+        bench_gapbuffer.cpp bench_compare.cpp bench_trace.cpp -o gv_bench -lbenchmark -lpthread &&
+    # The growth benchmarks read stats(), so they get a binary of their own
+    clang++ -std=c++20 -Wall -Wextra -O2 -march=native -DNDEBUG -DGAPBUFFER_STATS $CXXFLAGS \
+        bench_growth.cpp -o gv_bench_growth -lbenchmark -lpthread
+
+        if [ $? -eq 0 ]; then
+            ./gv_bench "$@" && ./gv_bench_growth "$@"
+        fi
+}
+
 function watch() {
     local file_path="test_gapbuffer.cpp"
     local last_mod_time=""
@@ -33,6 +47,9 @@ function watch() {
 
 if [[ "$1" == "--watch" ]]; then
     watch
+elif [[ "$1" == "--bench" ]]; then
+    shift
+    bench "$@"
 else
     compile $1
 fi
@@ -0,0 +1,793 @@
+#ifndef CHUNKED_GAPBUFFER_H
+#define CHUNKED_GAPBUFFER_H
+
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace gapbuffer_detail {
+    // Fenwick tree (binary indexed tree) over one value per leaf, giving prefix sums and the
+    // search for the leaf holding a given unit in O(log n)
+    template <typename T>
+    class FenwickTree {
+       public:
+        // Rebuild from scratch in O(n), `value_of(i)` being the value of leaf i
+        template <typename Fn>
+        void assign(std::size_t n, Fn&& value_of) {
+            tree.assign(n + 1, T());
+            for (std::size_t i = 1; i <= n; i++) {
+                tree[i] += value_of(i - 1);
+                const std::size_t parent = i + (i & -i);
+                if (parent <= n) {
+                    tree[parent] += tree[i];
+                }
+            }
+        }
+
+        void add(std::size_t i, T delta) noexcept {
+            for (i++; i < tree.size(); i += i & -i) {
+                tree[i] += delta;
+            }
+        }
+
+        void subtract(std::size_t i, T delta) noexcept {
+            for (i++; i < tree.size(); i += i & -i) {
+                tree[i] -= delta;
+            }
+        }
+
+        // Sum of the values of the first `n` leaves
+        [[nodiscard]] T prefix(std::size_t n) const noexcept {
+            T ret = T();
+            for (; n > 0; n -= n & -n) {
+                ret += tree[n];
+            }
+            return ret;
+        }
+
+        // Leaf holding the zero-based `target`th unit, and how many units of that leaf precede
+        // it. `target` must be less than the total
+        [[nodiscard]] std::pair<std::size_t, T> search(T target) const noexcept {
+            std::size_t leaf = 0;
+            std::size_t step = std::bit_floor(tree.size() - 1);
+            for (; step > 0; step >>= 1) {
+                if (leaf + step < tree.size() && tree[leaf + step] <= target) {
+                    leaf += step;
+                    target -= tree[leaf];
+                }
+            }
+            return {leaf, target};
+        }
+
+       private:
+        std::vector<T> tree;  // One-based, tree[0] is unused
+    };
+}  // namespace gapbuffer_detail
+
+// Gap buffer split into leaves of at most `ChunkSize` values, each of them a small gap buffer,
+// for files too large to keep in one contiguous allocation. The position of every leaf and the
+// number of newlines before it come from Fenwick trees, so finding a position costs O(log n)
+// and an edit within a leaf O(log n + ChunkSize) wherever the cursor is. An edit that splits a
+// leaf or merges two shifts the leaves after them and rebuilds both trees, O(n / ChunkSize),
+// but a leaf has to take or lose about a quarter of ChunkSize values between two of those, so
+// edits are O(log n + ChunkSize) amortized. Growing never copies more than a couple of leaves.
+// The interface follows BasicGapbuffer, with the gap replaced by a cursor that edits happen at.
+// Iterators are random access: a step within a leaf is O(1), a jump further O(log n)
+template <
+    typename CharT,
+    typename Allocator = std::allocator<CharT>,
+    std::size_t ChunkSize = 64 * 1024>
+class BasicChunkedGapbuffer {
+    static_assert(ChunkSize >= 16, "Leaves must be able to hold at least 16 values");
+
+   public:
+    // member types
+    using value_type = CharT;
+    using allocator_type = Allocator;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = CharT&;
+    using const_reference = const CharT&;
+    using string_type = std::basic_string<CharT>;
+    using string_view_type = std::basic_string_view<CharT>;
+
+    // Leaves only ever hold up to ChunkSize values, so their spare room is capped
+    using leaf_type = BasicGapbuffer<CharT, Allocator, GapbufferGrowth<16, 200, 50>>;
+
+    static constexpr size_type npos = static_cast<size_type>(-1);
+    static constexpr size_type chunk_size = ChunkSize;
+
+   private:
+    template <bool Const>
+    class IteratorTemplate {
+        using owner_type =
+            std::conditional_t<Const, const BasicChunkedGapbuffer*, BasicChunkedGapbuffer*>;
+
+       public:
+        using value_type = CharT;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const CharT*, CharT*>;
+        using reference = std::conditional_t<Const, const CharT&, CharT&>;
+        using iterator_category = std::random_access_iterator_tag;
+
+        IteratorTemplate() = default;
+        IteratorTemplate(owner_type owner, size_type leaf, size_type offset)
+            : owner(owner), leaf(leaf), offset(offset) {}
+
+        // Mutable iterators convert to const ones
+        operator IteratorTemplate<true>() const
+            requires(!Const)
+        {
+            return IteratorTemplate<true>(owner, leaf, offset);
+        }
+
+        reference operator*() const { return owner->leaves[leaf].text[offset]; }
+        pointer operator->() const { return &**this; }
+        reference operator[](difference_type n) const { return *(*this + n); }
+
+        IteratorTemplate& operator++() {
+            offset++;
+            if (offset == owner->leaves[leaf].text.size() && leaf + 1 < owner->leaves.size()) {
+                leaf++;
+                offset = 0;
+            }
+            return *this;
+        }
+
+        IteratorTemplate operator++(int) {
+            IteratorTemplate tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+
+        IteratorTemplate& operator--() {
+            if (offset == 0) {
+                leaf--;
+                offset = owner->leaves[leaf].text.size();
+            }
+            offset--;
+            return *this;
+        }
+
+        IteratorTemplate operator--(int) {
+            IteratorTemplate tmp = *this;
+            --(*this);
+            return tmp;
+        }
+
+        // Moves within the leaf directly, anything further goes through the leaf sizes
+        IteratorTemplate& operator+=(difference_type n) {
+            const size_type leaf_size = owner->leaves[leaf].text.size();
+            if (n >= 0 ? static_cast<size_type>(n) < leaf_size - offset
+                       : static_cast<size_type>(-n) <= offset) {
+                offset += n;
+                return *this;
+            }
+            const Location to = owner->locate(position() + n);
+            leaf = to.leaf;
+            offset = to.offset;
+            return *this;
+        }
+
+        IteratorTemplate& operator-=(difference_type n) { return *this += -n; }
+
+        IteratorTemplate operator+(difference_type n) const {
+            IteratorTemplate ret = *this;
+            return ret += n;
+        }
+
+        friend IteratorTemplate operator+(difference_type n, const IteratorTemplate& it) {
+            return it + n;
+        }
+
+        IteratorTemplate operator-(difference_type n) const {
+            IteratorTemplate ret = *this;
+            return ret -= n;
+        }
+
+        difference_type operator-(const IteratorTemplate& other) const {
+            if (leaf == other.leaf) {
+                return static_cast<difference_type>(offset) -
+                       static_cast<difference_type>(other.offset);
+            }
+            return static_cast<difference_type>(position()) -
+                   static_cast<difference_type>(other.position());
+        }
+
+        bool operator==(const IteratorTemplate& other) const noexcept {
+            return leaf == other.leaf && offset == other.offset;
+        }
+
+        // Iterators are always left on the leaf holding their value, so leaf and offset order
+        // them the same as their positions
+        std::strong_ordering operator<=>(const IteratorTemplate& other) const noexcept {
+            if (leaf != other.leaf) {
+                return leaf <=> other.leaf;
+            }
+            return offset <=> other.offset;
+        }
+
+       private:
+        // Offset of the value this points to from the start of the buffer
+        [[nodiscard]] size_type position() const noexcept {
+            return owner->sizes.prefix(leaf) + offset;
+        }
+
+        owner_type owner = nullptr;
+        size_type leaf = 0;
+        size_type offset = 0;
+    };
+
+   public:
+    using iterator = IteratorTemplate<false>;
+    using const_iterator = IteratorTemplate<true>;
+
+    // Constructors
+    BasicChunkedGapbuffer() : BasicChunkedGapbuffer(Allocator()) {}
+
+    explicit BasicChunkedGapbuffer(const Allocator& allocator)
+        : alloc(allocator), leaves(leaf_allocator(allocator)) {
+        leaves.push_back(Leaf{leaf_type(alloc), 0});
+        rebuild_index();
+
+        static_assert(std::random_access_iterator<iterator>);
+        static_assert(std::random_access_iterator<const_iterator>);
+    }
+
+    explicit BasicChunkedGapbuffer(string_view_type str, const Allocator& allocator = Allocator())
+        : BasicChunkedGapbuffer(allocator) {
+        insert_at(0, str);
+    }
+
+    BasicChunkedGapbuffer(std::initializer_list<CharT> lst, const Allocator& allocator = Allocator())
+        : BasicChunkedGapbuffer(string_view_type(lst.begin(), lst.size()), allocator) {}
+
+    [[nodiscard]] allocator_type get_allocator() const noexcept { return alloc; }
+
+    // A copy for readers on other threads that shares the storage of every leaf, with the same
+    // rules as BasicGapbuffer::snapshot(). An edit only ever copies the leaves it changes
+    [[nodiscard]] BasicChunkedGapbuffer snapshot() {
+        BasicChunkedGapbuffer ret(alloc);
+        ret.leaves.clear();
+        ret.leaves.reserve(leaves.size());
+        for (Leaf& leaf : leaves) {
+            ret.leaves.push_back(Leaf{leaf.text.snapshot(), leaf.newlines});
+        }
+        ret.sizes = sizes;
+        ret.newlines = newlines;
+        ret.length = length;
+        ret.cursor = cursor;
+        return ret;
+    }
+
+    // Element access
+    // Writes through references are not seen by the newline counts, as with the line index of
+    // BasicGapbuffer
+    [[nodiscard]] reference operator[](size_type loc) {
+        assert(loc < size() && "Out of bounds indexing");
+        const auto [leaf, offset] = locate(loc);
+        return leaves[leaf].text[offset];
+    }
+
+    [[nodiscard]] const_reference operator[](size_type loc) const {
+        assert(loc < size() && "Out of bounds indexing");
+        const auto [leaf, offset] = locate(loc);
+        return leaves[leaf].text[offset];
+    }
+
+    [[nodiscard]] reference at(size_type loc) {
+        if (loc >= size()) {
+            throw std::out_of_range("index out of range");
+        }
+        return (*this)[loc];
+    }
+
+    [[nodiscard]] const_reference at(size_type loc) const {
+        if (loc >= size()) {
+            throw std::out_of_range("index out of range");
+        }
+        return (*this)[loc];
+    }
+
+    // The contiguous run of values from `pos` to the end of its leaf or the gap within it.
+    // Empty at size()
+    [[nodiscard]] std::span<CharT> data_at(size_type pos) {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        const auto [leaf, offset] = locate(pos);
+        return leaves[leaf].text.data_at(offset);
+    }
+
+    [[nodiscard]] std::span<const CharT> data_at(size_type pos) const {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        const auto [leaf, offset] = locate(pos);
+        return std::as_const(leaves[leaf].text).data_at(offset);
+    }
+
+    [[nodiscard]] const_reference back() const {
+        if (empty()) {
+            throw std::out_of_range("Buffer is empty");
+        }
+        return leaves.back().text.back();
+    }
+
+    // Call `fn` with each non-empty contiguous run of values in order, as a std::span. If `fn`
+    // returns bool, returning false stops the walk. Returns whether every run was visited
+    template <typename Fn>
+    bool for_each_segment(Fn&& fn) const {
+        for (const Leaf& leaf : leaves) {
+            if (!leaf.text.for_each_segment(fn)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    [[nodiscard]] string_type to_str() const {
+        string_type ret;
+        ret.reserve(size());
+        for_each_segment([&](std::span<const CharT> s) { ret.append(s.data(), s.size()); });
+        return ret;
+    }
+
+    // The line containing `pos`, including its trailing newline if it has one
+    [[nodiscard]] string_type line(size_type pos) const {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        if (empty()) {
+            throw std::runtime_error("Cannot pull line from empty gapvector");
+        }
+
+        const size_type line_number = line_of(pos);
+        const size_type first = line_start(line_number);
+        const size_type newline = nth_newline(line_number);
+        const size_type last = (newline == npos) ? size() : newline + 1;
+        return copy_range(first, last - first);
+    }
+
+    // Zero-based number of the line that `pos` falls on, i.e. how many newlines precede it
+    [[nodiscard]] size_type line_of(size_type pos) const {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        const auto [leaf, offset] = locate(pos);
+        return newlines.prefix(leaf) + leaves[leaf].text.line_of(offset);
+    }
+
+    // Offset of the first value on the zero-based line `line_number`
+    [[nodiscard]] size_type line_start(size_type line_number) const {
+        if (line_number == 0) {
+            return 0;
+        }
+
+        const size_type newline = nth_newline(line_number - 1);
+        if (newline == npos) {
+            throw std::out_of_range("line number out of range");
+        }
+        return newline + 1;
+    }
+
+    // Search
+    // Offset of the `count`th occurrence of `c`, or -1 if there are not that many
+    [[nodiscard]] int find(CharT c, int count = 1) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        const size_type found = find_nth(c, count);
+        return (found == npos) ? -1 : static_cast<int>(found);
+    }
+
+    // Offset of the `count`th occurrence of `c` counting from 1, or npos if there are not that
+    // many. Newlines are found through the index, anything else leaf by leaf
+    [[nodiscard]] size_type find_nth(CharT c, size_type count) const {
+        if (count == 0) {
+            return npos;
+        }
+        if (c == CharT('\n')) {
+            return nth_newline(count - 1);
+        }
+
+        size_type remaining = count - 1;
+        size_type start = 0;
+        for (const Leaf& leaf : leaves) {
+            const size_type found = leaf.text.count(c);
+            if (remaining < found) {
+                return start + leaf.text.find_nth(c, remaining + 1);
+            }
+            remaining -= found;
+            start += leaf.text.size();
+        }
+        return npos;
+    }
+
+    // Number of occurrences of `c` in the buffer
+    [[nodiscard]] size_type count(CharT c) const noexcept {
+        if (c == CharT('\n')) {
+            return newlines.prefix(leaves.size());
+        }
+
+        size_type ret = 0;
+        for (const Leaf& leaf : leaves) {
+            ret += leaf.text.count(c);
+        }
+        return ret;
+    }
+
+    // Offset of the first occurrence of `needle` starting at or after `from`, or npos. Each leaf
+    // is searched in place, and only the few values either side of a leaf boundary are copied
+    // out to look for matches that run across it
+    [[nodiscard]] size_type find(string_view_type needle, size_type from = 0) const {
+        if (needle.empty()) {
+            return (from <= size()) ? from : npos;
+        }
+        if (from >= size()) {
+            return npos;
+        }
+
+        auto [leaf, offset] = locate(from);
+        size_type start = from - offset;
+        for (; leaf < leaves.size(); leaf++) {
+            const leaf_type& text = leaves[leaf].text;
+            const size_type found = text.find(needle, offset);
+            if (found != npos) {
+                return start + found;
+            }
+
+            const size_type end = start + text.size();
+            if (needle.size() > 1 && end < size()) {
+                const size_type window_first =
+                    std::max(start + offset, end - std::min(end, needle.size() - 1));
+                const size_type window_last = std::min(size(), end + needle.size() - 1);
+                const string_type window = copy_range(window_first, window_last - window_first);
+                const size_type in_window = string_view_type(window).find(needle);
+                if (in_window != npos) {
+                    return window_first + in_window;
+                }
+            }
+
+            start = end;
+            offset = 0;
+        }
+        return npos;
+    }
+
+    // Iterators
+    iterator begin() noexcept { return iterator(this, 0, 0); }
+    iterator end() noexcept { return iterator(this, leaves.size() - 1, leaves.back().text.size()); }
+    const_iterator begin() const noexcept { return const_iterator(this, 0, 0); }
+    const_iterator end() const noexcept {
+        return const_iterator(this, leaves.size() - 1, leaves.back().text.size());
+    }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    // Capacity
+    [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+    [[nodiscard]] size_type size() const noexcept { return length; }
+    [[nodiscard]] size_type leaf_count() const noexcept { return leaves.size(); }
+
+    [[nodiscard]] unsigned int line_count() const noexcept {
+        if (empty()) {
+            return 0;
+        }
+
+        size_type ret = newlines.prefix(leaves.size());
+        if (back() != CharT('\n')) {
+            ret++;
+        }
+        return ret;
+    }
+
+    // Modifiers
+    void clear() {
+        leaves.clear();
+        leaves.push_back(Leaf{leaf_type(alloc), 0});
+        rebuild_index();
+        length = 0;
+        cursor = 0;
+    }
+
+    // Insert at the cursor, leaving the cursor after the inserted values
+    void insert(string_view_type value) {
+        insert_at(cursor, value);
+        cursor += value.size();
+    }
+
+    void insert(size_type loc, string_view_type value) {
+        move_gap_to(loc);
+        insert(value);
+    }
+
+    // Append values that arrive in pieces, e.g. from a pipe. Unlike BasicGapbuffer the cursor
+    // stays where it is, so the buffer can be edited while the rest is still loading
+    void append_chunk(std::span<const CharT> chunk) {
+        insert_at(size(), string_view_type(chunk.data(), chunk.size()));
+    }
+
+    // Remove `count` values to the left of the cursor
+    void erase(size_type count) {
+        if (count > pos()) {
+            throw std::out_of_range("Cannot erase more values than precede the gap");
+        }
+        erase_at(cursor - count, count);
+        cursor -= count;
+    }
+
+    void push_back(const CharT& value) { insert(string_view_type(&value, 1)); }
+
+    // Intentionally discardable
+    CharT pop_back() {
+        if (cursor == 0) {
+            throw std::out_of_range("Buffer is empty");
+        }
+
+        const CharT ret = (*this)[cursor - 1];
+        erase(1);
+        return ret;
+    }
+
+    // Cursor
+    // The cursor plays the part of the gap: it is where insert(value) and erase(count) edit
+    [[nodiscard]] size_type pos() const noexcept { return cursor; }
+
+    void move_gap_to(size_type loc) {
+        if (loc > size()) {
+            throw std::out_of_range("Cannot move gap past the end of the buffer");
+        }
+        cursor = loc;
+    }
+
+    void move_gap(difference_type distance) {
+        if (distance < 0 && static_cast<size_type>(-distance) > pos()) {
+            throw std::out_of_range("Cannot move gap before the start of the buffer");
+        }
+        move_gap_to(pos() + distance);
+    }
+
+    // Move the cursor one position to the right. Does nothing if it is already at the end
+    void advance() {
+        if (cursor < size()) {
+            cursor++;
+        }
+    }
+
+    // Move the cursor one position to the left. Does nothing if it is already at the start
+    void retreat() {
+        if (cursor > 0) {
+            cursor--;
+        }
+    }
+
+   private:
+    struct Leaf {
+        leaf_type text;
+        size_type newlines;  // Kept with the leaf so that rebuilding the index never rescans
+    };
+
+    using leaf_allocator_type =
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Leaf>;
+
+    static leaf_allocator_type leaf_allocator(const Allocator& allocator) {
+        return leaf_allocator_type(allocator);
+    }
+
+    struct Location {
+        size_type leaf;
+        size_type offset;
+    };
+
+    // Leaf and offset within it of logical position `pos`. The end of the buffer is placed
+    // after the last value of the last leaf
+    [[nodiscard]] Location locate(size_type pos) const noexcept {
+        if (pos >= size()) {
+            return {leaves.size() - 1, leaves.back().text.size()};
+        }
+        const auto [leaf, offset] = sizes.search(pos);
+        return {leaf, offset};
+    }
+
+    // Offset of the zero-based `n`th newline, or npos if there are not that many
+    [[nodiscard]] size_type nth_newline(size_type n) const {
+        if (n >= newlines.prefix(leaves.size())) {
+            return npos;
+        }
+        const auto [leaf, before] = newlines.search(n);
+        return sizes.prefix(leaf) + leaves[leaf].text.find_nth(CharT('\n'), before + 1);
+    }
+
+    [[nodiscard]] static size_type count_newlines(string_view_type value) noexcept {
+        return gapbuffer_detail::count_values(value.data(), value.size(), CharT('\n'));
+    }
+
+    // Copy of the `count` values starting at `first`
+    [[nodiscard]] string_type copy_range(size_type first, size_type count) const {
+        string_type ret;
+        ret.reserve(count);
+
+        auto [leaf, offset] = locate(first);
+        while (ret.size() < count) {
+            const auto [lhs, rhs] = leaves[leaf].text.segments();
+            for (const auto& segment : {lhs, rhs}) {
+                if (offset < segment.size()) {
+                    const size_type n = std::min(segment.size() - offset, count - ret.size());
+                    ret.append(segment.data() + offset, n);
+                    offset = 0;
+                } else {
+                    offset -= segment.size();
+                }
+            }
+            leaf++;
+            offset = 0;
+        }
+        return ret;
+    }
+
+    void insert_at(size_type pos, string_view_type value) {
+        if (value.empty()) {
+            return;
+        }
+
+        const auto [leaf, offset] = locate(pos);
+        Leaf& target = leaves[leaf];
+        if (target.text.size() + value.size() > ChunkSize) {
+            split_insert(leaf, offset, value);
+            return;
+        }
+
+        const size_type lines = count_newlines(value);
+        target.text.insert(offset, value);
+        target.newlines += lines;
+        sizes.add(leaf, value.size());
+        newlines.add(leaf, lines);
+        length += value.size();
+    }
+
+    // Replace the leaf at `leaf` with enough half full leaves to hold its contents with `value`
+    // inserted at `offset`. Only this leaf and `value` are copied
+    void split_insert(size_type leaf, size_type offset, string_view_type value) {
+        const string_type old = leaves[leaf].text.to_str();
+        const string_view_type parts[] = {
+            string_view_type(old).substr(0, offset), value, string_view_type(old).substr(offset)};
+
+        const size_type total = old.size() + value.size();
+        const size_type fill = ChunkSize / 2;
+        const size_type count = (total + fill - 1) / fill;
+
+        std::vector<Leaf, leaf_allocator_type> pieces(leaf_allocator(alloc));
+        pieces.reserve(count);
+        size_type part = 0;
+        size_type part_offset = 0;
+        for (size_type i = 0; i < count; i++) {
+            // Spread evenly, so that no leaf ends up much smaller than the others
+            size_type want = total / count + (i < total % count ? 1 : 0);
+            Leaf piece{leaf_type(want + ChunkSize / 8, alloc), 0};
+            while (want > 0) {
+                const string_view_type chunk = parts[part].substr(part_offset, want);
+                piece.text.insert(chunk);
+                piece.newlines += count_newlines(chunk);
+                want -= chunk.size();
+                part_offset += chunk.size();
+                if (part_offset == parts[part].size()) {
+                    part++;
+                    part_offset = 0;
+                }
+            }
+            pieces.push_back(std::move(piece));
+        }
+
+        leaves[leaf] = std::move(pieces.front());
+        leaves.insert(leaves.begin() + leaf + 1, std::make_move_iterator(pieces.begin() + 1),
+                      std::make_move_iterator(pieces.end()));
+        length += value.size();
+        rebuild_index();
+    }
+
+    void erase_at(size_type pos, size_type count) {
+        if (count == 0) {
+            return;
+        }
+
+        auto [leaf, offset] = locate(pos);
+        const size_type first = leaf;
+        size_type remaining = count;
+        while (remaining > 0) {
+            Leaf& target = leaves[leaf];
+            const size_type n = std::min(remaining, target.text.size() - offset);
+            const size_type lines =
+                target.text.line_of(offset + n) - target.text.line_of(offset);
+
+            target.text.move_gap_to(offset + n);
+            target.text.erase(n);
+            target.newlines -= lines;
+            sizes.subtract(leaf, n);
+            newlines.subtract(leaf, lines);
+
+            remaining -= n;
+            leaf++;
+            offset = 0;
+        }
+        length -= count;
+        compact(first, leaf);
+    }
+
+    // After an erase over the leaves [first, last): drop the ones it emptied and fold small
+    // leaves around the edit into a neighbour, so that the number of leaves stays proportional
+    // to the size
+    void compact(size_type first, size_type last) {
+        bool changed = false;
+
+        const auto emptied = std::remove_if(
+            leaves.begin() + first, leaves.begin() + last,
+            [](const Leaf& leaf) { return leaf.text.empty(); });
+        if (emptied != leaves.begin() + last) {
+            leaves.erase(emptied, leaves.begin() + last);
+            changed = true;
+        }
+        if (leaves.empty()) {
+            leaves.push_back(Leaf{leaf_type(alloc), 0});
+        }
+
+        size_type i = (first > 0) ? first - 1 : 0;
+        while (i <= first && i + 1 < leaves.size()) {
+            const size_type lhs = leaves[i].text.size();
+            const size_type rhs = leaves[i + 1].text.size();
+            if ((lhs < ChunkSize / 4 || rhs < ChunkSize / 4) && lhs + rhs <= ChunkSize * 3 / 4) {
+                merge_with_next(i);
+                changed = true;
+            } else {
+                i++;
+            }
+        }
+
+        if (changed) {
+            rebuild_index();
+        }
+    }
+
+    void merge_with_next(size_type i) {
+        Leaf& lhs = leaves[i];
+        Leaf& rhs = leaves[i + 1];
+        lhs.text.move_gap_to(lhs.text.size());
+        rhs.text.for_each_segment([&](std::span<const CharT> s) {
+            lhs.text.insert(string_view_type(s.data(), s.size()));
+        });
+        lhs.newlines += rhs.newlines;
+        leaves.erase(leaves.begin() + i + 1);
+    }
+
+    void rebuild_index() {
+        sizes.assign(leaves.size(), [&](size_type i) { return leaves[i].text.size(); });
+        newlines.assign(leaves.size(), [&](size_type i) { return leaves[i].newlines; });
+    }
+
+    [[no_unique_address]] allocator_type alloc;
+    std::vector<Leaf, leaf_allocator_type> leaves;  // Never empty. Leaves are only empty when the
+                                                    // whole buffer is
+    gapbuffer_detail::FenwickTree<size_type> sizes;
+    gapbuffer_detail::FenwickTree<size_type> newlines;
+    size_type length = 0;
+    size_type cursor = 0;
+};
+
+using ChunkedGapbuffer = BasicChunkedGapbuffer<char>;
+
+#endif  // CHUNKED_GAPBUFFER_H
@@ -0,0 +1,398 @@
+#ifndef CONCURRENT_GAPBUFFER_H
+#define CONCURRENT_GAPBUFFER_H
+
+#include "gapbuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// One document shared between threads, such as a collaboration thread applying remote edits
+// and the UI thread. Readers take the current version, an immutable copy of the document held
+// by a shared_ptr, and a version stays valid for as long as they hold it. Reading only ever
+// loads the current version: it sits in one of two slots, and a reader counts itself into the
+// slot it copies from, so the writer only replaces a slot no reader is copying from. Readers
+// never wait for the writer and never apply edits. Edits from any thread are checked and
+// queued, and whichever thread finds no other writer busy applies the whole queue, turning each
+// run of edits that move forward through the document into a single apply_batch() sweep, and
+// publishes the result as the next version.
+//
+// Versions are buffers of their own rather than snapshot()s of the writer's, so the writer's
+// storage is never shared and edits never make it copy. A version that no reader holds any more
+// is brought up to date by replaying the edits it missed and published again. The document is
+// kept up to three times over: by the writer, the current version and the one before it. Only
+// a version still held when its turn comes round, or a change made through write(), costs a
+// full copy
+template <
+    typename CharT,
+    typename Allocator = std::allocator<CharT>,
+    typename Growth = GapbufferGrowth<>>
+class BasicConcurrentGapbuffer {
+   public:
+    // member types
+    using buffer_type = BasicGapbuffer<CharT, Allocator, Growth>;
+    using value_type = CharT;
+    using allocator_type = Allocator;
+    using size_type = typename buffer_type::size_type;
+    using difference_type = typename buffer_type::difference_type;
+    using string_view_type = typename buffer_type::string_view_type;
+
+    // One published state of the document. It is never modified while anyone else holds it, so
+    // any number of threads may read it, and views into `contents` stay valid for as long as
+    // the version is held
+    struct Version {
+        std::uint64_t number = 0;  // Increases by one with every version published
+        buffer_type contents;
+    };
+
+    // Constructors
+    BasicConcurrentGapbuffer() : BasicConcurrentGapbuffer(buffer_type()) {}
+
+    explicit BasicConcurrentGapbuffer(buffer_type initial)
+        : writer(std::move(initial)), projected(writer.size()) {
+        live = std::make_shared<Entry>(Version{published, buffer_type(writer)});
+        slots[0] = std::shared_ptr<const Version>(&live->version, Release{live});
+    }
+
+    BasicConcurrentGapbuffer(const BasicConcurrentGapbuffer&) = delete;
+    BasicConcurrentGapbuffer& operator=(const BasicConcurrentGapbuffer&) = delete;
+
+    // Reading. Each call reads the version current at the time, so a reader that needs several
+    // consistent reads should hold on to one version from current()
+    [[nodiscard]] std::shared_ptr<const Version> current() const {
+        for (;;) {
+            const unsigned slot = currentSlot.load();
+            readers[slot].fetch_add(1);
+            // The slot may have stopped being current before we were counted in, in which case
+            // the writer may already be replacing it
+            if (currentSlot.load() == slot) {
+                std::shared_ptr<const Version> ret = slots[slot];
+                readers[slot].fetch_sub(1);
+                return ret;
+            }
+            readers[slot].fetch_sub(1);
+        }
+    }
+
+    [[nodiscard]] std::uint64_t version() const { return current()->number; }
+
+    [[nodiscard]] size_type size() const { return current()->contents.size(); }
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    // Values are returned by copy, as the version they come from may be gone once this returns
+    [[nodiscard]] value_type operator[](size_type loc) const { return current()->contents[loc]; }
+
+    [[nodiscard]] value_type at(size_type loc) const { return current()->contents.at(loc); }
+
+    [[nodiscard]] auto line(size_type pos) const { return current()->contents.line(pos); }
+
+    [[nodiscard]] auto to_str() const { return current()->contents.to_str(); }
+
+    // Hand the current version to `fn` as one span per side of the gap, holding the version
+    // until `fn` returns. As BasicGapbuffer::for_each_segment(), `fn` may return false to stop.
+    // To keep the segments for longer, hold current() and use its contents.segments()
+    template <typename Fn>
+    bool for_each_segment(Fn&& fn) const {
+        const auto version = current();
+        return version->contents.for_each_segment(std::forward<Fn>(fn));
+    }
+
+    // Writing. Positions are offsets into the document as left by every edit queued before,
+    // as if each edit was applied on its own in the order they were queued
+
+    // Replace `erase_count` values starting at `pos` with `text`. The edit is applied and
+    // published before this returns unless another thread is busy writing, which then does it
+    // instead. An edit past the end of the document throws std::out_of_range here and is not
+    // queued. While a write() is running on another thread this waits for it
+    void edit(size_type pos, size_type erase_count, string_view_type text) {
+        {
+            std::lock_guard lock(queueMutex);
+            if (pos > projected || erase_count > projected - pos) {
+                throw std::out_of_range("Cannot edit past the end of the document");
+            }
+            queue.push_back(
+                Pending{pos, erase_count, std::vector<CharT>(text.begin(), text.end())});
+            projected = projected - erase_count + text.size();
+            queued.fetch_add(1);
+        }
+        try_apply();
+    }
+
+    void insert(size_type pos, string_view_type text) { edit(pos, 0, text); }
+
+    void erase(size_type pos, size_type count) { edit(pos, count, string_view_type()); }
+
+    // Apply and publish everything queued unless another thread is already writing. Returns
+    // false if it was, in which case that thread picks up the queue before it finishes
+    bool try_apply() {
+        while (queued.load() != 0) {
+            if (writing.exchange(true)) {
+                return false;
+            }
+            WriterToken token(*this);
+            drain();
+        }
+        return true;
+    }
+
+    // Wait for any other writer, then apply and publish everything queued so far
+    void flush() {
+        {
+            WriterToken token(*this, wait_tag{});
+            drain();
+        }
+        // Edits queued while we held the writer role would otherwise wait for the next writer
+        try_apply();
+    }
+
+    // Run `fn` with exclusive access to the writer's buffer, for changes that are not plain
+    // edits such as undo or enabling the line index, and publish the result. Queued edits are
+    // applied first, and edits from other threads wait until `fn` returns, so that they are
+    // checked against the document it leaves. `fn` must not call back into this object
+    template <typename Fn>
+    auto write(Fn&& fn) {
+        using Result = std::invoke_result_t<Fn, buffer_type&>;
+        if constexpr (std::is_void_v<Result>) {
+            exclusive([&] { std::forward<Fn>(fn)(writer); });
+        } else {
+            std::optional<Result> ret;
+            exclusive([&] { ret.emplace(std::forward<Fn>(fn)(writer)); });
+            return std::move(*ret);
+        }
+    }
+
+   private:
+    struct Pending {
+        size_type pos;
+        size_type erase_count;
+        std::vector<CharT> text;
+    };
+
+    struct wait_tag {};
+
+    // A version and whether every reader has let go of it. Readers share one shared_ptr to the
+    // version whose deleter only marks it released, while the writer keeps the entry
+    struct Entry {
+        Version version;
+        std::atomic<bool> released = false;
+    };
+
+    struct Release {
+        std::shared_ptr<Entry> entry;
+
+        void operator()(const Version*) noexcept {
+            // Whatever the last holder read happens before the writer reuses the version
+            entry->released.store(true, std::memory_order_release);
+            entry.reset();
+        }
+    };
+
+    // Gives up the writer role when it goes out of scope. try_apply() takes the role itself so
+    // that it can give up instead of waiting, the wait_tag constructor waits for it
+    struct WriterToken {
+        BasicConcurrentGapbuffer& self;
+
+        explicit WriterToken(BasicConcurrentGapbuffer& owner) noexcept : self(owner) {}
+
+        WriterToken(BasicConcurrentGapbuffer& owner, wait_tag) noexcept : self(owner) {
+            while (self.writing.exchange(true)) {
+                self.writing.wait(true);
+            }
+        }
+
+        ~WriterToken() {
+            self.writing.store(false);
+            self.writing.notify_all();
+        }
+    };
+
+    // Apply every queued edit and publish the result, with the writer role held
+    void drain() {
+        std::vector<Pending> work;
+        {
+            std::lock_guard lock(queueMutex);
+            work.swap(queue);
+            queued.fetch_sub(work.size());
+        }
+        if (work.empty() && !unpublished_changes()) {
+            return;
+        }
+        try {
+            apply(work);
+        } catch (...) {
+            std::lock_guard lock(queueMutex);
+            resync();
+            throw;
+        }
+        publish();
+    }
+
+    // write() with the result of `fn` handled by the caller
+    template <typename Body>
+    void exclusive(Body&& body) {
+        {
+            WriterToken token(*this, wait_tag{});
+            std::unique_lock lock(queueMutex);
+            std::vector<Pending> work;
+            work.swap(queue);
+            queued.fetch_sub(work.size());
+            try {
+                apply(work);
+                unpublishedReplayable = false;
+                body();
+            } catch (...) {
+                resync();
+                lock.unlock();
+                publish();
+                throw;
+            }
+            resync();
+            lock.unlock();
+            publish();
+        }
+        try_apply();
+    }
+
+    // Apply `work` to the writer's buffer and keep it for the versions that have yet to see it.
+    // The edits were checked when they were queued, so this only throws if apply_batch() does,
+    // such as when running out of memory. The sweep that threw may then be partly made as
+    // apply_batch() leaves it, so it and the rest of `work` are dropped rather than retried
+    void apply(std::vector<Pending>& work) {
+        std::size_t applied = 0;
+        try {
+            replay(writer, work, applied);
+        } catch (...) {
+            unpublishedReplayable = false;
+            throw;
+        }
+        unpublished.insert(unpublished.end(), std::make_move_iterator(work.begin()),
+                           std::make_move_iterator(work.end()));
+    }
+
+    // Apply the edits in `work` to `buf` in order. Sequential edits are gathered into one batch
+    // for as long as each starts at or after the end of the text the previous one left behind,
+    // since such a run maps back to sorted, non-overlapping offsets into the document as it was
+    // before the run. `applied` is left at the first edit of the batch that threw, if one did
+    static void replay(buffer_type& buf, const std::vector<Pending>& work, std::size_t& applied) {
+        std::vector<typename buffer_type::Edit> batch;
+        while (applied < work.size()) {
+            difference_type delta = 0;  // Change of size from the edits in the batch so far
+            size_type cursor = 0;       // End of the latest edit in the batch
+            std::size_t taken = applied;
+            batch.clear();
+
+            for (; taken < work.size(); taken++) {
+                const Pending& pending = work[taken];
+                if (!batch.empty() && pending.pos < cursor) {
+                    break;
+                }
+                batch.push_back({pending.pos - delta, pending.erase_count,
+                                 string_view_type(pending.text.data(), pending.text.size())});
+                cursor = pending.pos + pending.text.size();
+                delta += static_cast<difference_type>(pending.text.size()) -
+                         static_cast<difference_type>(pending.erase_count);
+            }
+
+            buf.apply_batch(batch, cursor);
+            applied = taken;
+        }
+    }
+
+    // With the queue mutex held, after the writer's buffer changed in a way the queue did not
+    // account for. Whatever is still queued was checked against the old size
+    void resync() noexcept {
+        projected = writer.size();
+        for (const Pending& pending : queue) {
+            projected = projected - std::min(pending.erase_count, projected) + pending.text.size();
+        }
+    }
+
+    // The writer's buffer differs from the current version
+    [[nodiscard]] bool unpublished_changes() const noexcept {
+        return !unpublished.empty() || !unpublishedReplayable;
+    }
+
+    // Make the writer's buffer the current version, with the writer role held. Only a slot no
+    // reader is counted into is written to. Readers counted into a slot that is not current go
+    // elsewhere without touching it, so the waits are over as soon as those notice
+    void publish() {
+        // The version before the current one missed the edits the current one was published
+        // with and everything since. If nobody holds it any more, it catches up on those
+        std::shared_ptr<Entry> next;
+        if (spare && spare->released.load(std::memory_order_acquire) && missedReplayable &&
+            unpublishedReplayable) {
+            next = std::move(spare);
+            try {
+                std::size_t applied = 0;
+                replay(next->version.contents, missed, applied);
+                applied = 0;
+                replay(next->version.contents, unpublished, applied);
+            } catch (...) {
+                next.reset();
+            }
+        }
+        if (next) {
+            next->version.number = published + 1;
+            next->released.store(false);
+        } else {
+            next = std::make_shared<Entry>(Version{published + 1, buffer_type(writer)});
+        }
+        spare.reset();
+        std::shared_ptr<const Version> handle(&next->version, Release{next});
+
+        const unsigned old_slot = currentSlot.load();
+        const unsigned new_slot = old_slot ^ 1;
+        while (readers[new_slot].load() != 0) {
+            std::this_thread::yield();
+        }
+        slots[new_slot] = std::move(handle);
+        currentSlot.store(new_slot);
+        published++;
+
+        // Readers still holding the previous version keep it from being released
+        while (readers[old_slot].load() != 0) {
+            std::this_thread::yield();
+        }
+        slots[old_slot].reset();
+        spare = std::move(live);
+        live = std::move(next);
+        missed = std::move(unpublished);
+        missedReplayable = unpublishedReplayable;
+        unpublished.clear();
+        unpublishedReplayable = true;
+    }
+
+    // Only touched with the writer role held
+    buffer_type writer;
+    std::uint64_t published = 1;        // Number of the current version
+    std::shared_ptr<Entry> live;        // The current version
+    std::shared_ptr<Entry> spare;       // The version before it
+    std::vector<Pending> missed;        // Edits the spare lacks that the current one has
+    std::vector<Pending> unpublished;   // Edits the current version lacks
+    bool missedReplayable = true;       // False if the spare lacks other changes as well
+    bool unpublishedReplayable = true;  // False if the current version does
+
+    std::shared_ptr<const Version> slots[2];
+    std::atomic<unsigned> currentSlot = 0;
+    mutable std::atomic<std::size_t> readers[2] = {0, 0};  // Readers counted into each slot
+
+    std::mutex queueMutex;  // Held to add to or take from the queue, and while write() runs
+    std::vector<Pending> queue;
+    size_type projected = 0;              // Size once everything queued is applied
+    std::atomic<std::size_t> queued = 0;  // Edits in `queue`
+    std::atomic<bool> writing = false;    // Some thread has the writer role
+};
+
+using ConcurrentGapbuffer = BasicConcurrentGapbuffer<char>;
+
+#endif  // CONCURRENT_GAPBUFFER_H
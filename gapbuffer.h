@@ -2,33 +2,496 @@
 #define GAPBUFFER_H
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <functional>
 #include <initializer_list>
 #include <iostream>
 #include <iterator>
 #include <memory>
-#include <optional>
+#include <memory_resource>
+#include <numeric>
 #include <ostream>
 #include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+#define GAPBUFFER_HAS_MMAP 1
+
+// Linux can grow a mapping in place, used by GapbufferGrowth's MapThreshold
+#ifdef MREMAP_MAYMOVE
+#define GAPBUFFER_HAS_MREMAP 1
+#endif
+#endif
+
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+#define GAPBUFFER_HAS_WRITEV 1
+#endif
+
+// Opt-in instrumentation, see GapbufferStats. Without the flag none of it is compiled in
+#ifdef GAPBUFFER_STATS
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Search kernels run directly over the contiguous segments either side of the gap
+namespace gapbuffer_detail {
+    // The value types std::char_traits knows, which get string views, strings and lines
+    template <typename T>
+    inline constexpr bool is_character_v =
+        std::is_same_v<T, char> || std::is_same_v<T, wchar_t> || std::is_same_v<T, char8_t> ||
+        std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
+    // Number of bytes equal to `value` in [first, first + len). Matches are accumulated in
+    // per-lane 8 bit counters that are widened at most every 255 vectors
+    inline std::size_t count_bytes(
+        const unsigned char* first,
+        std::size_t len,
+        unsigned char value) noexcept {
+        std::size_t ret = 0;
+        std::size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i needle = _mm256_set1_epi8(static_cast<char>(value));
+        while (len - i >= 32) {
+            const std::size_t block_end = i + 32 * std::min<std::size_t>(255, (len - i) / 32);
+            __m256i acc = _mm256_setzero_si256();
+            for (; i < block_end; i += 32) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+                acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+            }
+            const __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+            ret += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                   _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        }
+#elif defined(__SSE2__)
+        const __m128i needle = _mm_set1_epi8(static_cast<char>(value));
+        while (len - i >= 16) {
+            const std::size_t block_end = i + 16 * std::min<std::size_t>(255, (len - i) / 16);
+            __m128i acc = _mm_setzero_si128();
+            for (; i < block_end; i += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+                acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+            }
+            const __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+            ret += static_cast<std::size_t>(_mm_cvtsi128_si32(sums)) +
+                   static_cast<std::size_t>(_mm_extract_epi16(sums, 4));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const uint8x16_t needle = vdupq_n_u8(value);
+        while (len - i >= 16) {
+            const std::size_t block_end = i + 16 * std::min<std::size_t>(255, (len - i) / 16);
+            uint8x16_t acc = vdupq_n_u8(0);
+            for (; i < block_end; i += 16) {
+                acc = vsubq_u8(acc, vceqq_u8(vld1q_u8(first + i), needle));
+            }
+            ret += vaddlvq_u8(acc);
+        }
+#endif
+
+        for (; i < len; i++) {
+            ret += (first[i] == value);
+        }
+        return ret;
+    }
+
+    // Count the UTF-8 continuation bytes 10xxxxxx in [first, first + len). As signed values these
+    // are exactly the bytes below -64, so each vector needs a single compare
+    inline std::size_t count_continuations(const unsigned char* first, std::size_t len) noexcept {
+        std::size_t ret = 0;
+        std::size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i bound = _mm256_set1_epi8(-64);
+        while (len - i >= 32) {
+            const std::size_t block_end = i + 32 * std::min<std::size_t>(255, (len - i) / 32);
+            __m256i acc = _mm256_setzero_si256();
+            for (; i < block_end; i += 32) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + i));
+                acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(bound, v));
+            }
+            const __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+            ret += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+                   _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+        }
+#elif defined(__SSE2__)
+        const __m128i bound = _mm_set1_epi8(-64);
+        while (len - i >= 16) {
+            const std::size_t block_end = i + 16 * std::min<std::size_t>(255, (len - i) / 16);
+            __m128i acc = _mm_setzero_si128();
+            for (; i < block_end; i += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i));
+                acc = _mm_sub_epi8(acc, _mm_cmplt_epi8(v, bound));
+            }
+            const __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+            ret += static_cast<std::size_t>(_mm_cvtsi128_si32(sums)) +
+                   static_cast<std::size_t>(_mm_extract_epi16(sums, 4));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const int8x16_t bound = vdupq_n_s8(-64);
+        while (len - i >= 16) {
+            const std::size_t block_end = i + 16 * std::min<std::size_t>(255, (len - i) / 16);
+            uint8x16_t acc = vdupq_n_u8(0);
+            for (; i < block_end; i += 16) {
+                const int8x16_t v = vreinterpretq_s8_u8(vld1q_u8(first + i));
+                acc = vsubq_u8(acc, vcltq_s8(v, bound));
+            }
+            ret += vaddlvq_u8(acc);
+        }
+#endif
+
+        for (; i < len; i++) {
+            ret += ((first[i] & 0xC0) == 0x80);
+        }
+        return ret;
+    }
+
+    // Number of UTF-8 code points that start in [first, first + len). Wider values are taken to
+    // be one code point each
+    template <typename T>
+    std::size_t count_codepoints(const T* first, std::size_t len) noexcept {
+        if constexpr (sizeof(T) == 1) {
+            return len - count_continuations(reinterpret_cast<const unsigned char*>(first), len);
+        } else {
+            return len;
+        }
+    }
+
+    template <typename T>
+    std::size_t count_values(const T* first, std::size_t len, const T& value) noexcept {
+        if constexpr (sizeof(T) == 1 && std::is_integral_v<T>) {
+            return count_bytes(reinterpret_cast<const unsigned char*>(first), len,
+                               static_cast<unsigned char>(value));
+        } else {
+            return std::count(first, first + len, value);
+        }
+    }
+
+    // Find the zero-based `n`th copy of `value` in [first, first + len). Returns nullptr if there
+    // are fewer, in which case `n` is reduced by the number that were seen. Whole blocks are
+    // skipped using the counting kernel before narrowing down with memchr
+    template <typename T>
+    const T* find_nth_value(const T* first, std::size_t len, const T& value, std::size_t& n) {
+        constexpr std::size_t block = 4096;
+
+        for (std::size_t i = 0; i < len; i += block) {
+            const std::size_t block_len = std::min(block, len - i);
+            const std::size_t found = count_values(first + i, block_len, value);
+            if (found <= n) {
+                n -= found;
+                continue;
+            }
+
+            const T* p = first + i;
+            const T* last = first + i + block_len;
+            while (true) {
+                p = std::find(p, last, value);
+                if (n-- == 0) {
+                    return p;
+                }
+                p++;
+            }
+        }
+        return nullptr;
+    }
+
+    // Run `task(i)` for every i in [0, tasks) on up to `threads` threads, the calling one
+    // included. Workers claim tasks from a shared counter, so a slow chunk does not hold up the rest
+    template <typename Task>
+    void parallel_for(std::size_t tasks, unsigned threads, Task task) {
+        std::atomic<std::size_t> next = 0;
+        auto work = [&] {
+            for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < tasks;) {
+                task(i);
+            }
+        };
+
+        // Joined on scope exit, including when starting one of them throws
+        std::vector<std::jthread> workers;
+        const std::size_t count = std::min<std::size_t>(threads, tasks);
+        workers.reserve(count > 0 ? count - 1 : 0);
+        for (std::size_t i = 1; i < count; i++) {
+            workers.emplace_back(work);
+        }
+        work();
+    }
+}  // namespace gapbuffer_detail
+
+// Selects the multithreaded scans, as in buf.count(gapbuffer_parallel, '\n'). The buffer is cut
+// into chunks that are scanned on every core and the per-chunk results merged
+struct GapbufferParallel {
+    unsigned threads = 0;                 // 0 starts one thread per core
+    std::size_t chunk = 256 * 1024;       // Values per task, small enough to stay in a core's L2
+    std::size_t min_size = 4 * 1024 * 1024;  // Smaller buffers are scanned on the calling thread
+};
+
+inline constexpr GapbufferParallel gapbuffer_parallel{};
+
+#ifdef GAPBUFFER_STATS
+// Counters kept by every buffer when built with GAPBUFFER_STATS, read through stats()
+struct GapbufferStats {
+    enum class Op { insert, erase, push_back, pop_back, move_gap, reallocate, count };
+
+    // Bucket i counts operations that took less than 2^i but at least 2^(i-1) nanoseconds
+    using histogram = std::array<std::uint64_t, 40>;
+
+    std::uint64_t reallocations = 0;
+    std::uint64_t bytes_reallocated = 0;  // Contents written by reallocations, only what moved
+    std::uint64_t gap_moves = 0;          // Gap relocations, including advance() and retreat()
+    std::uint64_t bytes_moved = 0;        // Contents shifted across the gap by those relocations
+    std::uint64_t edits = 0;              // Inserts, erases, push_backs and pop_backs
+    std::uint64_t gap_distance = 0;       // Total distance in values the gap has been moved
+
+    std::array<histogram, static_cast<std::size_t>(Op::count)> op_time{};
+
+    // How far the gap had to travel for each edit, on average
+    [[nodiscard]] double average_gap_distance() const noexcept {
+        return edits == 0 ? 0.0 : static_cast<double>(gap_distance) / static_cast<double>(edits);
+    }
+
+    [[nodiscard]] const histogram& time_of(Op op) const noexcept {
+        return op_time[static_cast<std::size_t>(op)];
+    }
+};
+
+namespace gapbuffer_detail {
+    // Adds its own lifetime to one of the histograms of a GapbufferStats
+    class StatsTimer {
+       public:
+        constexpr StatsTimer(GapbufferStats& stats, GapbufferStats::Op op) noexcept
+            : hist(stats.op_time[static_cast<std::size_t>(op)]) {
+            if (!std::is_constant_evaluated()) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        constexpr ~StatsTimer() {
+            if (!std::is_constant_evaluated()) {
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count();
+                const auto bucket = std::bit_width(static_cast<std::uint64_t>(ns));
+                hist[std::min<std::size_t>(bucket, hist.size() - 1)]++;
+            }
+        }
+
+       private:
+        GapbufferStats::histogram& hist;
+        std::chrono::steady_clock::time_point start{};
+    };
+}  // namespace gapbuffer_detail
+#endif
+
+// Growth policy for BasicGapbuffer
+// MinGap:        gap left after the contents by the constructors that take contents, and by
+//                shrink_to_fit()
+// FactorPercent: how much the capacity is multiplied by each time the gap fills up
+// MaxGapPercent: if non-zero, the gap left by growing is capped at this share of the contents
+//                (but never below MinGap), so large buffers do not waste up to half their memory
+// MapThreshold:  if non-zero, growing to at least this many bytes maps the storage directly
+//                instead of taking it from the allocator, in 2 MiB aligned huge pages that are
+//                grown in place with mremap(). Only used for trivially copyable values, on Linux
+template <
+    std::size_t MinGap = 8,
+    std::size_t FactorPercent = 200,
+    std::size_t MaxGapPercent = 0,
+    std::size_t MapThreshold = 0>
+struct GapbufferGrowth {
+    static_assert(FactorPercent > 100, "Growth factor must be larger than 100%");
+
+    static constexpr std::size_t min_gap = MinGap;
+    static constexpr std::size_t map_threshold = MapThreshold;
+
+    // Capacity to grow a buffer of `capacity` to so that more than `required` values fit
+    [[nodiscard]] static constexpr std::size_t grow(
+        std::size_t capacity,
+        std::size_t required) noexcept {
+        std::size_t ret = std::max<std::size_t>(capacity, 1);
+        while (ret <= required) {
+            ret = std::max(ret + 1, ret / 100 * FactorPercent + ret % 100 * FactorPercent / 100);
+        }
+
+        if constexpr (MaxGapPercent != 0) {
+            const std::size_t max_gap = std::max<std::size_t>(
+                {MinGap, required / 100 * MaxGapPercent, 1});
+            ret = std::min(ret, required + max_gap);
+        }
+        return ret;
+    }
+};
 
 // Gap buffer data structure implementation: https://en.wikipedia.org/wiki/Gap_buffer
-class Gapbuffer {
+// All storage is obtained through `Allocator`, which may be stateful (such as a
+// std::pmr::polymorphic_allocator pointing at an arena)
+//
+// CharT may be any character type, or any other copyable value type such as per-character
+// attribute records. Runs of those are passed as std::span instead of a string view, and the text
+// operations (lines, searching for substrings, to_str) are only available for character types.
+// Trivially copyable values are moved with memmove and their gap is never initialized. Any other
+// type keeps a live, value-initialized object in every slot of the gap, which is assigned to
+// when the slot is filled
+
+template <
+    typename CharT,
+    typename Allocator = std::allocator<CharT>,
+    typename Growth = GapbufferGrowth<>>
+class BasicGapbuffer {
+    using alloc_traits = std::allocator_traits<Allocator>;
+
    public:
     // member types
-    using value_type = char;
-    using allocator_type = std::allocator<char>;
+    using value_type = CharT;
+    using allocator_type = Allocator;
+    using growth_policy = Growth;
     using size_type = std::size_t;
     using difference_type = std::ptrdiff_t;
-    using reference = char&;
-    using const_reference = const char&;
-    using pointer = std::allocator_traits<std::allocator<char>>::pointer;
-    using const_pointer = std::allocator_traits<std::allocator<char>>::const_pointer;
+    using reference = CharT&;
+    using const_reference = const CharT&;
+    using pointer = typename alloc_traits::pointer;
+    using const_pointer = typename alloc_traits::const_pointer;
+    using string_type = std::basic_string<CharT>;
+    using string_view_type = std::conditional_t<gapbuffer_detail::is_character_v<CharT>,
+                                                std::basic_string_view<CharT>,
+                                                std::span<const CharT>>;
+
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    // Buffers with a capacity up to this many values keep them inside the object, so small
+    // buffers such as prompts and command lines never allocate
+    static constexpr size_type inline_capacity = std::max<size_type>(32 / sizeof(CharT), 2);
+
+    // One edit of a batch given to apply_batch(). `erase_count` values starting at `pos` are
+    // replaced with `text`, where `pos` is an offset into the buffer as it was before the batch
+    struct Edit {
+        size_type pos;
+        size_type erase_count = 0;
+        string_view_type text;
+    };
+
+    // One line, trailing newline included, as the parts before and after the gap. Nothing is
+    // copied, so like the view returned by erase() it is only valid until the next modification
+    struct LineView {
+        size_type start = 0;  // Offset of the first value of the line
+        string_view_type left;
+        string_view_type right;
+
+        [[nodiscard]] constexpr size_type size() const noexcept {
+            return left.size() + right.size();
+        }
+        [[nodiscard]] constexpr bool empty() const noexcept { return size() == 0; }
+
+        [[nodiscard]] constexpr const CharT& operator[](size_type i) const noexcept {
+            return (i < left.size()) ? left[i] : right[i - left.size()];
+        }
+
+        [[nodiscard]] string_type to_str() const {
+            string_type ret;
+            ret.reserve(size());
+            ret.append(left);
+            ret.append(right);
+            return ret;
+        }
+
+        [[nodiscard]] friend constexpr bool operator==(const LineView& line,
+                                                       string_view_type text) noexcept {
+            return line.size() == text.size() && text.substr(0, line.left.size()) == line.left &&
+                   text.substr(line.left.size()) == line.right;
+        }
+    };
+
+    // Lazy forward range over consecutive lines, each found with the vectorized search when
+    // the iterator reaches it. Only valid while the buffer is not modified
+    class LineRange : public std::ranges::view_interface<LineRange> {
+       public:
+        class iterator {
+           public:
+            using iterator_concept = std::forward_iterator_tag;
+            using iterator_category = std::input_iterator_tag;
+            using value_type = LineView;
+            using difference_type = std::ptrdiff_t;
+
+            constexpr iterator() = default;
+
+            [[nodiscard]] LineView operator*() const { return buf->view_of(start, end); }
+
+            iterator& operator++() {
+                start = end;
+                end = buf->line_end(start);
+                return *this;
+            }
+
+            iterator operator++(int) {
+                iterator ret = *this;
+                ++*this;
+                return ret;
+            }
+
+            [[nodiscard]] friend bool operator==(const iterator& a, const iterator& b) noexcept {
+                return a.start == b.start;
+            }
+
+           private:
+            friend class LineRange;
+
+            iterator(const BasicGapbuffer* buffer, size_type from, size_type to)
+                : buf(buffer), start(from), end(to) {}
+
+            const BasicGapbuffer* buf = nullptr;
+            size_type start = 0;
+            size_type end = 0;
+        };
+
+        constexpr LineRange() = default;
+
+        [[nodiscard]] iterator begin() const {
+            return iterator(buf, first, first == last ? last : buf->line_end(first));
+        }
+        // Compared by start offset only, so the end of the last line is not looked for
+        [[nodiscard]] iterator end() const { return iterator(buf, last, last); }
+
+       private:
+        friend class BasicGapbuffer;
+
+        LineRange(const BasicGapbuffer* buffer, size_type from, size_type to)
+            : buf(buffer), first(from), last(to) {}
+
+        const BasicGapbuffer* buf = nullptr;
+        size_type first = 0;  // Offsets of the first line and of the end of the last one
+        size_type last = 0;
+    };
+
+    static_assert(std::is_same_v<typename alloc_traits::value_type, CharT>,
+                  "Allocator::value_type must match the buffer's value_type");
 
    private:
     // Iterator built from: https://medium.com/p/fc5b994462c6#90c4
@@ -40,9 +503,9 @@ class Gapbuffer {
        public:
         static const bool is_const = std::is_const_v<std::remove_pointer_t<pointer_type>>;
 
-        using value_type = typename std::conditional<is_const, const char, char>::type;
+        using value_type = typename std::conditional<is_const, const CharT, CharT>::type;
         using gapbuffer_ptr_type =
-            typename std::conditional<is_const, const Gapbuffer*, Gapbuffer*>::type;
+            typename std::conditional<is_const, const BasicGapbuffer*, BasicGapbuffer*>::type;
         using difference_type = std::ptrdiff_t;
         using pointer = pointer_type;
         using reference = value_type&;
@@ -54,7 +517,7 @@ class Gapbuffer {
 
         reference operator*() const { return *ptr; }
         pointer operator->() const { return ptr; }
-        reference operator[](difference_type n) const { return *(ptr + n); }
+        reference operator[](difference_type n) const { return *(*this + n); }
 
         IteratorTemplate& operator++() {
             ptr++;
@@ -68,17 +531,15 @@ class Gapbuffer {
         IteratorTemplate operator++(int) {
             IteratorTemplate tmp = *this;
             ++(*this);
-            if (ptr == buf_ptr->gapStart) {
-                ptr = buf_ptr->gapEnd;
-            }
             return tmp;
         }
 
+        // The value before gapEnd is the last one before the gap
         IteratorTemplate& operator--() {
-            ptr--;
-            if (ptr == buf_ptr->gapStart) {
-                ptr = buf_ptr->gapEnd;
+            if (ptr == buf_ptr->gapEnd) {
+                ptr = buf_ptr->gapStart;
             }
+            ptr--;
             return *this;
         }
 
@@ -86,22 +547,11 @@ class Gapbuffer {
         IteratorTemplate operator--(int) {
             IteratorTemplate tmp = *this;
             --(*this);
-            if (ptr == buf_ptr->gapStart) {
-                ptr = buf_ptr->gapEnd;
-            }
             return tmp;
         }
 
         IteratorTemplate operator+(const difference_type other) const {
-            pointer new_ptr = ptr + other;
-
-            if (ptr <= buf_ptr->gapStart && new_ptr > buf_ptr->gapStart) {
-                new_ptr += (buf_ptr->gapEnd - buf_ptr->gapStart);
-            } else if (ptr >= buf_ptr->gapEnd && new_ptr < buf_ptr->gapEnd) {
-                new_ptr -= (buf_ptr->gapEnd - buf_ptr->gapStart);
-            }
-
-            return IteratorTemplate(ptr + other, buf_ptr);
+            return IteratorTemplate(at(index() + other), buf_ptr);
         }
 
         friend IteratorTemplate operator+(
@@ -115,15 +565,7 @@ class Gapbuffer {
         }
 
         IteratorTemplate operator-(const difference_type other) const {
-            pointer new_ptr = ptr - other;
-
-            if (ptr >= buf_ptr->gapEnd && new_ptr < buf_ptr->gapEnd) {
-                new_ptr -= (buf_ptr->gapEnd - buf_ptr->gapStart);
-            } else if (ptr <= buf_ptr->gapStart && new_ptr > buf_ptr->gapStart) {
-                new_ptr += (buf_ptr->gapEnd - buf_ptr->gapStart);
-            }
-
-            return IteratorTemplate(ptr - other, buf_ptr);
+            return IteratorTemplate(at(index() - other), buf_ptr);
         }
 
         friend IteratorTemplate operator-(
@@ -132,34 +574,92 @@ class Gapbuffer {
             return other - value;
         }
 
-        friend difference_type operator-(
-            const IteratorTemplate& self,
-            const IteratorTemplate& other) {
-            difference_type distance = self.ptr - other.ptr;
-
-            // Adjust for gap
-            if (self.ptr > self.buf_ptr->gapStart && other.ptr <= self.buf_ptr->gapStart) {
-                distance -= (self.buf_ptr->gapEnd - self.buf_ptr->gapStart);
-            } else if (self.ptr <= self.buf_ptr->gapStart && other.ptr > self.buf_ptr->gapStart) {
-                distance += (self.buf_ptr->gapEnd - self.buf_ptr->gapStart);
-            }
-
-            return distance;
+        difference_type operator-(const IteratorTemplate& other) const {
+            return index() - other.index();
         }
 
         IteratorTemplate& operator+=(difference_type n) {
-            ptr += n;
+            ptr = at(index() + n);
             return *this;
         }
 
         IteratorTemplate& operator-=(difference_type n) {
-            ptr -= n;
+            ptr = at(index() - n);
             return *this;
         }
 
         auto operator<=>(const IteratorTemplate&) const = default;
 
+        // Segmented iterator protocol: the contiguous runs of values in [*this, last), one on
+        // each side of the gap. Either may be empty
+        [[nodiscard]] std::pair<std::span<value_type>, std::span<value_type>> segments_to(
+            const IteratorTemplate& last) const noexcept {
+            pointer_type gap_start = buf_ptr->gapStart;
+            pointer_type gap_end = buf_ptr->gapEnd;
+            if (ptr >= gap_start) {
+                pointer_type first = std::max(ptr, gap_end);
+                return {{}, {first, static_cast<std::size_t>(std::max(last.ptr, first) - first)}};
+            }
+            if (last.ptr <= gap_start) {
+                return {{ptr, static_cast<std::size_t>(std::max(last.ptr, ptr) - ptr)}, {}};
+            }
+            return {
+                {ptr, static_cast<std::size_t>(gap_start - ptr)},
+                {gap_end, static_cast<std::size_t>(std::max(last.ptr, gap_end) - gap_end)}};
+        }
+
+        // Algorithms found by ADL for unqualified calls, which run over each segment as a plain
+        // contiguous range instead of checking for the gap on every step
+        friend difference_type count(
+            const IteratorTemplate& first,
+            const IteratorTemplate& last,
+            const CharT& value) noexcept {
+            const auto [lhs, rhs] = first.segments_to(last);
+            return gapbuffer_detail::count_values(lhs.data(), lhs.size(), value) +
+                   gapbuffer_detail::count_values(rhs.data(), rhs.size(), value);
+        }
+
+        friend IteratorTemplate find(
+            const IteratorTemplate& first,
+            const IteratorTemplate& last,
+            const CharT& value) {
+            const auto [lhs, rhs] = first.segments_to(last);
+            for (const auto& segment : {lhs, rhs}) {
+                std::size_t n = 0;
+                if (auto p = gapbuffer_detail::find_nth_value(
+                        segment.data(), segment.size(), value, n)) {
+                    return IteratorTemplate(segment.data() + (p - segment.data()), first.buf_ptr);
+                }
+            }
+            return last;
+        }
+
+        template <typename OutputIt>
+        friend OutputIt copy(const IteratorTemplate& first, const IteratorTemplate& last, OutputIt out) {
+            const auto [lhs, rhs] = first.segments_to(last);
+            return std::copy(rhs.begin(), rhs.end(), std::copy(lhs.begin(), lhs.end(), out));
+        }
+
+        template <typename InputIt>
+        friend bool equal(const IteratorTemplate& first, const IteratorTemplate& last, InputIt other) {
+            const auto [lhs, rhs] = first.segments_to(last);
+            const auto [lhs_end, rest] = std::mismatch(lhs.begin(), lhs.end(), other);
+            return lhs_end == lhs.end() && std::equal(rhs.begin(), rhs.end(), rest);
+        }
+
        private:
+        // Offset of ptr among the values, and the pointer to the value at an offset, so that
+        // arithmetic steps over the gap
+        [[nodiscard]] difference_type index() const noexcept {
+            const pointer_type gap_start = buf_ptr->gapStart;
+            return ptr <= gap_start ? ptr - buf_ptr->bufferStart
+                                    : (gap_start - buf_ptr->bufferStart) + (ptr - buf_ptr->gapEnd);
+        }
+        [[nodiscard]] pointer_type at(difference_type n) const noexcept {
+            const difference_type lhs_size = buf_ptr->gapStart - buf_ptr->bufferStart;
+            return n < lhs_size ? buf_ptr->bufferStart + n : buf_ptr->gapEnd + (n - lhs_size);
+        }
+
         pointer_type ptr;
         gapbuffer_ptr_type buf_ptr;
     };
@@ -172,152 +672,335 @@ class Gapbuffer {
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
     // Constructors
-    constexpr explicit Gapbuffer() {
-        bufferStart = allocator_type().allocate(32);
-        bufferEnd = std::uninitialized_value_construct_n(bufferStart, 32);
+    constexpr BasicGapbuffer() : BasicGapbuffer(Allocator()) {}
+
+    // Every constructor first delegates to the empty one, so that if a value throws while being
+    // copied in the destructor still releases what was acquired
+    constexpr explicit BasicGapbuffer(const Allocator& allocator)
+        : BasicGapbuffer(empty_tag{}, allocator) {
+        bufferStart = acquire_storage(32);
+        bufferEnd = bufferStart + 32;
         gapStart = bufferStart;
         gapEnd = bufferEnd;
 
         static_assert(std::random_access_iterator<iterator>);
         static_assert(std::random_access_iterator<const_iterator>);
-        static_assert(std::ranges::random_access_range<Gapbuffer>);
+        static_assert(std::ranges::random_access_range<BasicGapbuffer>);
     }
 
-    constexpr explicit Gapbuffer(const size_type length) {
+    constexpr explicit BasicGapbuffer(
+        const size_type length,
+        const Allocator& allocator = Allocator())
+        : BasicGapbuffer(empty_tag{}, allocator) {
         if (length < 2) {
             throw std::runtime_error("Cannot construct gapbuffer with capacity < 2");
         }
 
-        bufferStart = allocator_type().allocate(length);
-        bufferEnd = std::uninitialized_value_construct_n(bufferStart, length);
+        bufferStart = acquire_storage(length);
+        bufferEnd = bufferStart + length;
         gapStart = bufferStart;
         gapEnd = bufferEnd;
 
         static_assert(std::random_access_iterator<iterator>);
         static_assert(std::random_access_iterator<const_iterator>);
-        static_assert(std::ranges::random_access_range<Gapbuffer>);
+        static_assert(std::ranges::random_access_range<BasicGapbuffer>);
     }
 
-    constexpr explicit Gapbuffer(std::string_view str) {
-        bufferStart = allocator_type().allocate(str.size() + 8);
+    constexpr explicit BasicGapbuffer(
+        string_view_type str,
+        const Allocator& allocator = Allocator())
+        : BasicGapbuffer(empty_tag{}, allocator) {
+        bufferStart = acquire_storage(str.size() + Growth::min_gap);
+        bufferEnd = bufferStart + str.size() + Growth::min_gap;
 
-        const auto [_, final_destination] =
-            std::uninitialized_move_n(str.begin(), str.size(), bufferStart);
-        gapStart = final_destination;
-        gapEnd = gapStart + 8;
-        bufferEnd = gapEnd;
+        gapStart = std::copy(str.begin(), str.end(), bufferStart);
+        gapEnd = bufferEnd;
 
         static_assert(std::random_access_iterator<iterator>);
         static_assert(std::random_access_iterator<const_iterator>);
-        static_assert(std::ranges::random_access_range<Gapbuffer>);
+        static_assert(std::ranges::random_access_range<BasicGapbuffer>);
     }
 
     template <typename InputIt>
-    constexpr explicit Gapbuffer(InputIt begin, InputIt end) {
-        const unsigned int len = std::distance(begin, end);
+    constexpr explicit BasicGapbuffer(
+        InputIt begin,
+        InputIt end,
+        const Allocator& allocator = Allocator())
+        : BasicGapbuffer(empty_tag{}, allocator) {
+        const size_type len = std::distance(begin, end);
 
-        bufferStart = allocator_type().allocate(len + 8);
+        bufferStart = acquire_storage(len + Growth::min_gap);
+        bufferEnd = bufferStart + len + Growth::min_gap;
 
-        auto [_, final_destination] = std::uninitialized_move_n(begin, len, bufferStart);
-        gapStart = final_destination;
-        gapEnd = gapStart + 8;
-        bufferEnd = gapEnd;
+        gapStart = std::copy_n(begin, len, bufferStart);
+        gapEnd = bufferEnd;
 
         static_assert(std::random_access_iterator<iterator>);
         static_assert(std::random_access_iterator<const_iterator>);
-        static_assert(std::ranges::random_access_range<Gapbuffer>);
+        static_assert(std::ranges::random_access_range<BasicGapbuffer>);
     }
 
-    constexpr Gapbuffer(std::initializer_list<char> lst) {
-        bufferStart = allocator_type().allocate(lst.size());
-        const auto [_, final_destination] =
-            std::uninitialized_move_n(lst.begin(), lst.size(), bufferStart);
-        gapStart = final_destination;
-        gapEnd = gapStart + 8;
-        bufferEnd = gapEnd;
+    constexpr BasicGapbuffer(
+        std::initializer_list<CharT> lst,
+        const Allocator& allocator = Allocator())
+        : BasicGapbuffer(empty_tag{}, allocator) {
+        bufferStart = acquire_storage(lst.size() + Growth::min_gap);
+        bufferEnd = bufferStart + lst.size() + Growth::min_gap;
+
+        gapStart = std::copy(lst.begin(), lst.end(), bufferStart);
+        gapEnd = bufferEnd;
 
         static_assert(std::random_access_iterator<iterator>);
         static_assert(std::random_access_iterator<const_iterator>);
-        static_assert(std::ranges::random_access_range<Gapbuffer>);
+        static_assert(std::ranges::random_access_range<BasicGapbuffer>);
     }
 
     // Copy Constructor
-    constexpr Gapbuffer(const Gapbuffer& other) {
-        bufferStart = allocator_type().allocate(other.capacity());
-        bufferEnd = std::uninitialized_copy_n(other.bufferStart, other.capacity(), bufferStart);
-        gapStart = bufferStart + (other.gapStart - other.bufferStart);
+    constexpr BasicGapbuffer(const BasicGapbuffer& other)
+        : BasicGapbuffer(empty_tag{},
+                         alloc_traits::select_on_container_copy_construction(other.alloc)) {
+        bufferStart = acquire_storage(other.capacity());
+        bufferEnd = bufferStart + other.capacity();
+        gapStart = std::copy(other.bufferStart, other.gapStart, bufferStart);
         gapEnd = bufferStart + (other.gapEnd - other.bufferStart);
+        std::copy(other.gapEnd, other.bufferEnd, gapEnd);
+
+        if (other.lineIndex) {
+            lineIndex = std::make_unique<LineIndex>(*other.lineIndex);
+        }
+        if (other.codepointIndex) {
+            codepointIndex = std::make_unique<CodepointIndex>(*other.codepointIndex);
+        }
+        if (other.journal) {
+            journal = std::make_unique<Journal>(*other.journal);
+        }
     }
 
     // Copy Assignment
-    constexpr Gapbuffer& operator=(const Gapbuffer& other) {
+    constexpr BasicGapbuffer& operator=(const BasicGapbuffer& other) {
         if (this != &other) {
-            bufferStart = allocator_type().allocate(other.capacity());
+            if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+                if (alloc != other.alloc) {
+                    release();
+                    bufferStart = gapStart = gapEnd = bufferEnd = nullptr;
+                    alloc = other.alloc;
+                }
+            }
 
-            gapStart = std::uninitialized_copy_n(other.bufferStart, other.capacity(), bufferStart);
+            // Our own inline storage can only be reused once it has been released
+            if (other.capacity() <= inline_capacity) {
+                release();
+                bufferStart = gapStart = gapEnd = bufferEnd = nullptr;
+            }
 
-            gapEnd = bufferStart + (other.gapEnd - other.bufferStart);
+            pointer new_mem = acquire_storage(other.capacity());
+            pointer new_gap_start = std::copy(other.bufferStart, other.gapStart, new_mem);
+            pointer new_gap_end = new_mem + (other.gapEnd - other.bufferStart);
+            std::copy(other.gapEnd, other.bufferEnd, new_gap_end);
+
+            release();
+            bufferStart = new_mem;
+            gapStart = new_gap_start;
+            gapEnd = new_gap_end;
             bufferEnd = bufferStart + other.capacity();
+
+            lineIndex = other.lineIndex ? std::make_unique<LineIndex>(*other.lineIndex) : nullptr;
+            codepointIndex = other.codepointIndex
+                                 ? std::make_unique<CodepointIndex>(*other.codepointIndex)
+                                 : nullptr;
+            journal = other.journal ? std::make_unique<Journal>(*other.journal) : nullptr;
         }
         return *this;
     }
 
     // Move Constructor
-    constexpr Gapbuffer(Gapbuffer&& other) {
-        bufferStart = allocator_type().allocate(other.capacity());
-
-        const auto [_, moved] =
-            std::uninitialized_move_n(other.bufferStart, other.capacity(), bufferStart);
-        bufferEnd = moved;
-        gapStart = bufferStart + (other.gapStart - other.bufferStart);
-        gapEnd = bufferStart + (other.gapEnd - other.bufferStart);
-
-        other.bufferStart = nullptr;
-        other.gapStart = nullptr;
-        other.gapEnd = nullptr;
-        other.bufferEnd = nullptr;
-
-        allocator_type().deallocate(other.bufferStart, other.capacity());
+    // Allocated and mapped storage is taken over as is, inline values are moved across
+    constexpr BasicGapbuffer(BasicGapbuffer&& other) noexcept(
+        std::is_nothrow_move_constructible_v<CharT>)
+        : alloc(std::move(other.alloc)),
+          bufferStart(nullptr),
+          gapStart(nullptr),
+          gapEnd(nullptr),
+          bufferEnd(nullptr) {
+        steal(other);
     }
 
     // Move Assignment Operator
-    constexpr Gapbuffer& operator=(Gapbuffer&& other) {
+    // Storage can only be stolen when the allocators agree on who owns it, otherwise the values
+    // are copied into memory from our own allocator
+    constexpr BasicGapbuffer& operator=(BasicGapbuffer&& other) noexcept(
+        (alloc_traits::propagate_on_container_move_assignment::value ||
+         alloc_traits::is_always_equal::value) &&
+        std::is_nothrow_move_constructible_v<CharT>) {
         if (this != &other) {
-            std::destroy_n(bufferStart, capacity());
-            allocator_type().deallocate(bufferStart, capacity());
+            if constexpr (!alloc_traits::propagate_on_container_move_assignment::value &&
+                          !alloc_traits::is_always_equal::value) {
+                if (alloc != other.alloc) {
+                    return *this = static_cast<const BasicGapbuffer&>(other);
+                }
+            }
 
-            bufferStart = std::exchange(other.bufferStart, {});
-            gapStart = std::exchange(other.gapStart, {});
-            gapEnd = std::exchange(other.gapEnd, {});
-            bufferEnd = std::exchange(other.bufferEnd, {});
+            release();
+            bufferStart = gapStart = gapEnd = bufferEnd = nullptr;
+            if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+                alloc = std::move(other.alloc);
+            }
+            steal(other);
         }
         return *this;
     }
 
-    ~Gapbuffer() {
-        std::destroy_n(bufferStart, capacity());
-        allocator_type().deallocate(bufferStart, capacity());
+    // Exchange contents with `other`. Allocators are only exchanged if they propagate on swap,
+    // otherwise they must compare equal
+    constexpr void swap(BasicGapbuffer& other) noexcept(
+        std::is_nothrow_move_constructible_v<CharT>) {
+        if (this == &other) {
+            return;
+        }
+        if constexpr (alloc_traits::propagate_on_container_swap::value) {
+            using std::swap;
+            swap(alloc, other.alloc);
+        }
+
+        BasicGapbuffer tmp(empty_tag{}, alloc);
+        tmp.steal(other);
+        other.steal(*this);
+        steal(tmp);
     }
 
-    // Operator Overloads
-    friend std::ostream& operator<<(std::ostream& os, const Gapbuffer& buf) {
-        os << "[";
-        for (auto p = buf.bufferStart; p < buf.bufferEnd; p++) {
-            if (p >= buf.gapStart && p < buf.gapEnd) {
-                os << " ";
-            } else {
-                os << *p;
+    friend constexpr void swap(BasicGapbuffer& lhs, BasicGapbuffer& rhs) noexcept(
+        noexcept(lhs.swap(rhs))) {
+        lhs.swap(rhs);
+    }
+
+    constexpr ~BasicGapbuffer() { release(); }
+
+#ifdef GAPBUFFER_HAS_MMAP
+    // Open `path` as a private, copy-on-write memory mapping instead of reading it into memory.
+    // Reading the buffer only touches the pages that are looked at, and the contents are copied
+    // into storage from the allocator the first time an edit needs room in the gap
+    [[nodiscard]] static BasicGapbuffer from_file(
+        const std::filesystem::path& path,
+        const Allocator& allocator = Allocator())
+        requires(sizeof(CharT) == 1)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path.string());
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == -1) {
+            const int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "Cannot stat " + path.string());
+        }
+
+        const auto length = static_cast<size_type>(st.st_size);
+        if (length == 0) {
+            ::close(fd);
+            return BasicGapbuffer(allocator);
+        }
+
+        void* mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        const int err = errno;
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            throw std::system_error(err, std::generic_category(), "Cannot map " + path.string());
+        }
+
+        return BasicGapbuffer(static_cast<pointer>(mem), length, allocator);
+    }
+#endif
+
+#ifdef GAPBUFFER_STATS
+    // Snapshot of the counters collected since construction or the last reset_stats()
+    [[nodiscard]] GapbufferStats stats() const noexcept { return statsData; }
+
+    void reset_stats() noexcept { statsData = GapbufferStats(); }
+#endif
+
+    // True while the values are stored inside the object rather than in allocated storage
+    [[nodiscard]] constexpr bool is_inline() const noexcept { return bufferStart == inlineStorage; }
+
+    // True while the contents are still backed by the mapping made by from_file()
+    [[nodiscard]] constexpr bool is_mapped() const noexcept {
+        return mappedLength != 0 && !mappedAnonymous;
+    }
+
+    // True while the storage is a huge page mapping made because of Growth::map_threshold
+    [[nodiscard]] constexpr bool is_page_mapped() const noexcept {
+        return mappedLength != 0 && mappedAnonymous;
+    }
+
+    // A copy for readers on other threads that shares this buffer's storage instead of copying
+    // it. Either side only gets storage of its own, and pays for the copy, once an edit would
+    // overwrite values the other can still see. Typing at the gap after taking a snapshot
+    // writes into space no snapshot reads, so it never copies, and an edit made after every
+    // snapshot is gone takes the storage back without copying. The line index comes along, the
+    // undo journal does not. While snapshots are alive values must only be changed through the
+    // modifiers, not written through references, iterators or spans
+    [[nodiscard]] BasicGapbuffer snapshot() {
+        if (is_inline()) {
+            BasicGapbuffer ret(alloc);
+            ret.reallocate(capacity());
+            ret.gapStart = std::copy(bufferStart, gapStart, ret.bufferStart);
+            ret.gapEnd = ret.bufferStart + (gapEnd - bufferStart);
+            std::copy(gapEnd, bufferEnd, ret.gapEnd);
+            if (lineIndex) {
+                ret.lineIndex = std::make_unique<LineIndex>(*lineIndex);
+            }
+            if (codepointIndex) {
+                ret.codepointIndex = std::make_unique<CodepointIndex>(*codepointIndex);
             }
+            return ret;
+        }
+
+        BasicGapbuffer ret(empty_tag{}, alloc);
+        if (lineIndex) {
+            ret.lineIndex = std::make_unique<LineIndex>(*lineIndex);
         }
-        os << "]";
+        if (codepointIndex) {
+            ret.codepointIndex = std::make_unique<CodepointIndex>(*codepointIndex);
+        }
+        share_storage();
+
+        // From now on only the part of the gap that every snapshot also has as its gap may be
+        // written to. The snapshot itself may not write to the storage at all
+        frozenStart = std::max(frozenStart, gapStart);
+        frozenEnd = std::max(frozenStart, std::min(frozenEnd, gapEnd));
+        ret.bufferStart = bufferStart;
+        ret.gapStart = ret.frozenStart = ret.frozenEnd = gapStart;
+        ret.gapEnd = gapEnd;
+        ret.bufferEnd = bufferEnd;
+        ret.sharedStorage = sharedStorage;
+        return ret;
+    }
+
+    // True while the storage is shared with snapshots, or was and has not been written to since
+    [[nodiscard]] bool is_shared() const noexcept { return sharedStorage != nullptr; }
+
+    [[nodiscard]] constexpr allocator_type get_allocator() const noexcept { return alloc; }
+
+    // Operator Overloads
+    friend std::basic_ostream<CharT>& operator<<(
+        std::basic_ostream<CharT>& os,
+        const BasicGapbuffer& buf) {
+        const auto [lhs, rhs] = buf.segments();
+
+        os << CharT('[');
+        os.write(lhs.data(), lhs.size());
+        std::fill_n(std::ostreambuf_iterator<CharT>(os), buf.gap_size(), CharT(' '));
+        os.write(rhs.data(), rhs.size());
+        os << CharT(']');
 
         return os;
     }
 
+    // Unchecked like the standard containers, only asserted in debug builds. Use at() for a
+    // checked access, or data_at() to walk contiguous runs without working out the gap per index
     [[nodiscard]] constexpr reference operator[](const size_type& loc) {
-        if (loc > size()) {
-            throw std::out_of_range("Out of bounds indexing");
-        }
+        assert(loc < size() && "Out of bounds indexing");
 
         if (loc < static_cast<size_type>(gapStart - bufferStart)) {
             return *(bufferStart + loc);
@@ -327,9 +1010,7 @@ class Gapbuffer {
     }
 
     [[nodiscard]] constexpr const_reference operator[](const size_type& loc) const {
-        if (loc > size()) {
-            throw std::out_of_range("Out of bounds indexing");
-        }
+        assert(loc < size() && "Out of bounds indexing");
 
         if (loc < static_cast<size_type>(gapStart - bufferStart)) {
             return *(bufferStart + loc);
@@ -338,17 +1019,36 @@ class Gapbuffer {
         }
     }
 
-    [[nodiscard]] bool operator==(const Gapbuffer& other) const noexcept {
+    // Compares the contents segment by segment, which needs at most three block comparisons
+    // depending on where each gap sits
+    [[nodiscard]] constexpr bool operator==(const BasicGapbuffer& other) const noexcept {
         if (size() != other.size()) {
             return false;
         }
-        if (to_str() != other.to_str()) {
-            return false;
+
+        const auto [lhs_left, lhs_right] = segments();
+        const auto [rhs_left, rhs_right] = other.segments();
+        std::span<const CharT> lhs[] = {lhs_left, lhs_right};
+        std::span<const CharT> rhs[] = {rhs_left, rhs_right};
+
+        for (std::size_t i = 0, j = 0; i < 2 && j < 2;) {
+            if (lhs[i].empty()) {
+                i++;
+            } else if (rhs[j].empty()) {
+                j++;
+            } else {
+                const size_type len = std::min(lhs[i].size(), rhs[j].size());
+                if (!std::equal(lhs[i].begin(), lhs[i].begin() + len, rhs[j].begin())) {
+                    return false;
+                }
+                lhs[i] = lhs[i].subspan(len);
+                rhs[j] = rhs[j].subspan(len);
+            }
         }
         return true;
     }
 
-    [[nodiscard]] bool operator!=(const Gapbuffer& other) const noexcept = default;
+    [[nodiscard]] bool operator!=(const BasicGapbuffer& other) const noexcept = default;
 
     // Element Access
     // TODO: When I upgrade to c++23, look into `deducing this` and `std::forward_like` to
@@ -432,15 +1132,106 @@ class Gapbuffer {
         return *(bufferEnd - 1);
     }
 
-    [[nodiscard]] const std::string to_str() const noexcept {
-        std::string ret;
+    // The values before and after the gap as two contiguous views, without copying. Either may
+    // be empty. They are invalidated by any modification of the buffer
+    [[nodiscard]] constexpr std::pair<std::span<const CharT>, std::span<const CharT>> segments()
+        const noexcept {
+        return {std::span<const CharT>(bufferStart, gapStart),
+                std::span<const CharT>(gapEnd, bufferEnd)};
+    }
+
+    // The contiguous run of values from `pos` up to the gap or the end of the buffer, whichever
+    // comes first. Empty at size(). Invalidated by any modification of the buffer
+    [[nodiscard]] constexpr std::span<CharT> data_at(size_type pos) {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+
+        const size_type left = gapStart - bufferStart;
+        if (pos < left) {
+            return std::span<CharT>(bufferStart + pos, gapStart);
+        }
+        return std::span<CharT>(gapEnd + (pos - left), bufferEnd);
+    }
+
+    [[nodiscard]] constexpr std::span<const CharT> data_at(size_type pos) const {
+        return const_cast<BasicGapbuffer&>(*this).data_at(pos);
+    }
+
+    // Call `fn` with each non-empty contiguous run of values in order, as a std::span. If `fn`
+    // returns bool, returning false stops the walk. Returns whether every segment was visited
+    template <typename Fn>
+    constexpr bool for_each_segment(Fn&& fn) const {
+        const auto [lhs, rhs] = segments();
+        return visit_segment(fn, lhs) && visit_segment(fn, rhs);
+    }
+
+    template <typename Fn>
+    constexpr bool for_each_segment(Fn&& fn) {
+        return visit_segment(fn, std::span<CharT>(bufferStart, gapStart)) &&
+               visit_segment(fn, std::span<CharT>(gapEnd, bufferEnd));
+    }
+
+    // Write the contents to `os` as two block writes, skipping the gap without joining the
+    // halves into a temporary string first
+    std::basic_ostream<CharT>& write_to(std::basic_ostream<CharT>& os) const {
+        const auto [lhs, rhs] = segments();
+        os.write(lhs.data(), lhs.size());
+        os.write(rhs.data(), rhs.size());
+        return os;
+    }
+
+#ifdef GAPBUFFER_HAS_WRITEV
+    // Write the contents to a file descriptor, handing both segments to the kernel in a single
+    // writev(). Short writes and EINTR are retried until everything has been written
+    void write_to(int fd) const {
+        const auto [lhs, rhs] = segments();
+        ::iovec iov[] = {
+            {const_cast<CharT*>(lhs.data()), lhs.size_bytes()},
+            {const_cast<CharT*>(rhs.data()), rhs.size_bytes()},
+        };
+
+        ::iovec* current = iov;
+        int remaining = 2;
+        while (remaining > 0) {
+            if (current->iov_len == 0) {
+                current++;
+                remaining--;
+                continue;
+            }
+
+            const ::ssize_t written = ::writev(fd, current, remaining);
+            if (written == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "writev failed");
+            }
+
+            auto len = static_cast<std::size_t>(written);
+            while (remaining > 0 && len >= current->iov_len) {
+                len -= current->iov_len;
+                current++;
+                remaining--;
+            }
+            if (remaining > 0) {
+                current->iov_base = static_cast<std::byte*>(current->iov_base) + len;
+                current->iov_len -= len;
+            }
+        }
+    }
+#endif
+
+    [[nodiscard]] const string_type to_str() const noexcept {
+        string_type ret;
         ret.reserve(size());
         ret.append(bufferStart, (gapStart - bufferStart));
         ret.append(gapEnd, (bufferEnd - gapEnd));
         return ret;
     }
 
-    [[nodiscard]] std::string line(size_type pos) const {
+    // The line containing `pos`, including its trailing newline if it has one
+    [[nodiscard]] string_type line(size_type pos) const {
         if (pos > size()) {
             throw std::out_of_range("index out of range");
         }
@@ -448,47 +1239,216 @@ class Gapbuffer {
             throw std::runtime_error("Cannot pull line from empty gapvector");
         }
 
-        auto range = std::ranges::subrange(begin(), end());
+        const size_type line_number = line_of(pos);
+        const size_type first = line_start(line_number);
+        const size_type newline = nth_newline(line_number);
+        const size_type last = (newline == npos) ? size() : newline + 1;
 
-        auto line_start =
-            std::ranges::find(std::ranges::reverse_view(range | std::views::take(pos)), '\n')
-                .base();
-
-        auto line_end = std::ranges::find(std::ranges::drop_view(range, pos - 1), '\n');
+        string_type ret;
+        ret.reserve(last - first);
+        const size_type left = this->pos();
+        if (first < left) {
+            ret.append(bufferStart + first, std::min(last, left) - first);
+        }
+        if (last > left) {
+            const size_type from = std::max(first, left) - left;
+            ret.append(gapEnd + from, last - left - from);
+        }
+        return ret;
+    }
 
-        if (line_end == range.end()) {
-            line_end = end();
-        } else {
-            line_end++;
+    // As line(), but as a view into the buffer instead of a new string
+    [[nodiscard]] LineView line_view(size_type pos) const {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        if (empty()) {
+            throw std::runtime_error("Cannot pull line from empty gapvector");
         }
 
-        return std::string(line_start, line_end);
+        const size_type first = line_start(line_of(pos));
+        return view_of(first, line_end(first));
     }
 
-    [[nodiscard]] int find(char c, int count = 1) const {
-        if (count == 0) {
-            return 0;
+    // The zero-based lines [first_line, last_line), or every line, as a lazy range of views.
+    // An empty buffer has no lines, as for line_count()
+    [[nodiscard]] LineRange lines(size_type first_line, size_type last_line) const {
+        if (first_line > last_line) {
+            throw std::out_of_range("line range out of order");
+        }
+        return LineRange(this, line_offset(first_line), line_offset(last_line));
+    }
+
+    [[nodiscard]] LineRange lines() const { return LineRange(this, 0, size()); }
+
+    // Zero-based number of the line that `pos` falls on, i.e. how many newlines precede it
+    [[nodiscard]] size_type line_of(size_type pos) const {
+        if (pos > size()) {
+            throw std::out_of_range("index out of range");
         }
 
-        int tracking_count = 0;
-        for (auto it = begin(); it != end(); ++it) {
-            if (*it == c) {
-                ++tracking_count;
-                if (count == tracking_count) {
-                    return std::distance(begin(), it);
-                }
+        if (lineIndex) {
+            const auto& [before, after] = *lineIndex;
+            if (pos <= this->pos()) {
+                return std::lower_bound(before.begin(), before.end(), pos) - before.begin();
             }
+            return before.size() + (after.end() - std::upper_bound(after.begin(), after.end(),
+                                                                    size() - pos));
         }
 
-        return -1;
+        return count_range(0, pos, CharT('\n'));
     }
 
-    // Iterators
-    iterator begin() noexcept { return iterator(bufferStart, this); }
-    iterator end() noexcept { return iterator(bufferEnd, this); }
-    const_iterator begin() const noexcept { return const_iterator(bufferStart, this); }
+    // Offset of the first value on the zero-based line `line_number`
+    [[nodiscard]] size_type line_start(size_type line_number) const {
+        if (line_number == 0) {
+            return 0;
+        }
+
+        const size_type newline = nth_newline(line_number - 1);
+        if (newline == npos) {
+            throw std::out_of_range("line number out of range");
+        }
+        return newline + 1;
+    }
+
+    // Offset of the `count`th occurrence of `c`, or -1 if there are not that many
+    [[nodiscard]] int find(CharT c, int count = 1) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        const size_type found = find_nth(c, count);
+        return (found == npos) ? -1 : static_cast<int>(found);
+    }
+
+    // Offset of the `count`th occurrence of `c` counting from 1, or npos if there are not that
+    // many. Both segments are searched in place with vectorized kernels
+    [[nodiscard]] size_type find_nth(CharT c, size_type count) const {
+        if (count == 0) {
+            return npos;
+        }
+
+        return find_nth_from(0, c, count - 1);
+    }
+
+    // Number of occurrences of `c` in the buffer
+    [[nodiscard]] size_type count(CharT c) const noexcept { return count_range(0, size(), c); }
+
+    // Parallel versions of the scans above. Each chunk is counted on its own thread, and find
+    // walks the per-chunk counts to the one chunk holding the occurrence before searching it.
+    // Buffers below `par.min_size` are scanned serially. Throws std::system_error if threads
+    // cannot be started
+    [[nodiscard]] size_type count(const GapbufferParallel& par, CharT c) const {
+        if (!parallel_worthwhile(par)) {
+            return count(c);
+        }
+
+        const auto counts = chunk_counts(par, c);
+        return std::accumulate(counts.begin(), counts.end(), size_type(0));
+    }
+
+    [[nodiscard]] size_type find_nth(const GapbufferParallel& par, CharT c, size_type count) const {
+        if (count == 0 || !parallel_worthwhile(par)) {
+            return find_nth(c, count);
+        }
+
+        const auto counts = chunk_counts(par, c);
+        size_type remaining = count - 1;
+        for (size_type i = 0; i < counts.size(); i++) {
+            if (remaining < counts[i]) {
+                return find_nth_from(i * parallel_chunk(par), c, remaining);
+            }
+            remaining -= counts[i];
+        }
+        return npos;
+    }
+
+    [[nodiscard]] int find(const GapbufferParallel& par, CharT c, int count = 1) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        const size_type found = find_nth(par, c, count);
+        return (found == npos) ? -1 : static_cast<int>(found);
+    }
+
+    // Offset of the first occurrence of `needle` starting at or after `from`, or npos. Each
+    // segment is searched in place (first value filter + compare), and the few start positions
+    // where a match would straddle the gap are checked separately
+    [[nodiscard]] size_type find(string_view_type needle, size_type from = 0) const noexcept {
+        const size_type len = size();
+        if (needle.size() > len || from > len - needle.size()) {
+            return npos;
+        }
+        if (needle.empty()) {
+            return from;
+        }
+
+        const auto [left, right] = string_segments();
+        if (from < left.size()) {
+            if (const size_type found = left.find(needle, from); found != npos) {
+                return found;
+            }
+
+            const size_type straddle_first =
+                std::max(from, left.size() - std::min(left.size(), needle.size() - 1));
+            for (size_type start = straddle_first; start < left.size(); start++) {
+                if (straddles_match(start, needle)) {
+                    return start;
+                }
+            }
+        }
+
+        const size_type right_from = (from > left.size()) ? from - left.size() : 0;
+        const size_type found = right.find(needle, right_from);
+        return (found == npos) ? npos : left.size() + found;
+    }
+
+    // Offset of the last occurrence of `needle` starting at or before `from`, or npos
+    [[nodiscard]] size_type rfind(string_view_type needle, size_type from = npos) const noexcept {
+        const size_type len = size();
+        if (needle.size() > len) {
+            return npos;
+        }
+        from = std::min(from, len - needle.size());
+        if (needle.empty()) {
+            return from;
+        }
+
+        const auto [left, right] = string_segments();
+        if (from >= left.size()) {
+            if (const size_type found = right.rfind(needle, from - left.size()); found != npos) {
+                return left.size() + found;
+            }
+        }
+
+        // Candidates that start before the gap but end after it
+        const size_type straddle_last = std::min(from + 1, left.size());
+        const size_type straddle_first = left.size() - std::min(left.size(), needle.size() - 1);
+        for (size_type start = straddle_last; start > straddle_first; start--) {
+            if (straddles_match(start - 1, needle)) {
+                return start - 1;
+            }
+        }
+
+        if (left.size() >= needle.size()) {
+            return left.rfind(needle, std::min(from, left.size() - needle.size()));
+        }
+        return npos;
+    }
+
+    // Iterators
+    // When the gap sits at the very start, the first value lives at gapEnd
+    iterator begin() noexcept {
+        return iterator((gapStart == bufferStart) ? gapEnd : bufferStart, this);
+    }
+    iterator end() noexcept { return iterator(bufferEnd, this); }
+    const_iterator begin() const noexcept {
+        return const_iterator((gapStart == bufferStart) ? gapEnd : bufferStart, this);
+    }
     const_iterator end() const noexcept { return const_iterator(bufferEnd, this); }
-    const_iterator cbegin() const noexcept { return const_iterator(bufferStart, this); }
+    const_iterator cbegin() const noexcept { return begin(); }
     const_iterator cend() const noexcept { return const_iterator(bufferEnd, this); }
 
     reverse_iterator rbegin() noexcept {
@@ -516,130 +1476,1558 @@ class Gapbuffer {
     }
 
     // Capacity
-    [[nodiscard]] constexpr bool empty() const noexcept { return bufferStart == gapStart; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return size() == 0; }
     [[nodiscard]] constexpr size_type size() const noexcept {
         return bufferEnd - bufferStart - (gapEnd - gapStart);
     }
     [[nodiscard]] constexpr size_type gap_size() const noexcept { return gapEnd - gapStart; }
     [[nodiscard]] constexpr size_type capacity() const noexcept { return bufferEnd - bufferStart; }
+    // Logical position of the gap, i.e. the number of values to its left
+    [[nodiscard]] constexpr size_type pos() const noexcept { return gapStart - bufferStart; }
 
     constexpr void reserve(size_type new_cap) {
         if (new_cap > capacity()) {
-            pointer new_mem = allocator_type().allocate(new_cap);
-            pointer new_end = std::uninitialized_value_construct_n(new_mem, new_cap);
-
-            const auto [_, lhs_buf] =
-                std::uninitialized_move_n(bufferStart, gapStart - bufferStart, new_mem);
-            gapStart = lhs_buf;
-
-            std::size_t rhs_size = bufferEnd - gapEnd;
-            std::uninitialized_move_n(gapEnd, rhs_size, new_end - rhs_size);
+            reallocate(new_cap);
+        }
+    }
 
-            bufferStart = new_mem;
-            bufferEnd = new_end;
-            gapStart = lhs_buf;
-            gapEnd = bufferEnd - rhs_size;
+    // Give memory back after large deletions, leaving a gap of Growth::min_gap
+    constexpr void shrink_to_fit() {
+        const size_type new_cap = std::max<size_type>(size() + Growth::min_gap, 2);
+        if (new_cap < capacity()) {
+            reallocate(new_cap);
         }
     }
 
     [[nodiscard]] constexpr unsigned int line_count() const noexcept {
-        if (bufferStart == gapStart && bufferEnd == gapEnd) {
+        if (empty()) {
             return 0;
         }
-        int newlines = std::count(begin(), end(), '\n');
-        if (back() != '\n') {
+
+        size_type newlines = 0;
+        if (lineIndex) {
+            newlines = lineIndex->before.size() + lineIndex->after.size();
+        } else {
+            newlines = count_range(0, size(), CharT('\n'));
+        }
+
+        if (back() != CharT('\n')) {
             newlines++;
         }
         return newlines;
     }
 
+    // An index already makes line_count() constant time, so only unindexed buffers are scanned
+    [[nodiscard]] unsigned int line_count(const GapbufferParallel& par) const {
+        if (lineIndex || empty() || !parallel_worthwhile(par)) {
+            return line_count();
+        }
+        return count(par, CharT('\n')) + (back() != CharT('\n') ? 1 : 0);
+    }
+
+    // Line index
+    // Keep the offsets of all newlines up to date as the buffer is edited, so that line_count(),
+    // line_of(), line_start() and line() no longer scan the text. Writes made directly through
+    // references to values are not tracked, use the modifiers when the index is enabled
+    void enable_line_index() {
+        if (lineIndex) {
+            return;
+        }
+
+        auto index = std::make_unique<LineIndex>(alloc);
+        for (pointer p = bufferStart; p != gapStart; p++) {
+            if (is_newline(*p)) {
+                index->before.push_back(p - bufferStart);
+            }
+        }
+        for (pointer p = bufferEnd; p != gapEnd; p--) {
+            if (is_newline(*(p - 1))) {
+                index->after.push_back(bufferEnd - (p - 1));
+            }
+        }
+        lineIndex = std::move(index);
+    }
+
+    void disable_line_index() noexcept { lineIndex.reset(); }
+
+    [[nodiscard]] bool has_line_index() const noexcept { return lineIndex != nullptr; }
+
+    // UTF-8
+    // Offsets everywhere else count bytes. These count code points instead: a code point is any
+    // byte that is not a continuation byte 10xxxxxx, counted over both segments in place with
+    // vectorized kernels. Malformed input is not rejected, stray continuation bytes simply do
+    // not start a code point
+    [[nodiscard]] size_type codepoint_count() const
+        requires(sizeof(CharT) == 1)
+    {
+        return codepoints_before(size());
+    }
+
+    // Number of code points that start before byte offset `byte`
+    [[nodiscard]] size_type codepoint_offset(size_type byte) const
+        requires(sizeof(CharT) == 1)
+    {
+        if (byte > size()) {
+            throw std::out_of_range("index out of range");
+        }
+        return codepoints_before(byte);
+    }
+
+    // Byte offset at which the zero-based code point `codepoint` starts, or size() for the
+    // code point count itself
+    [[nodiscard]] size_type byte_offset(size_type codepoint) const
+        requires(sizeof(CharT) == 1)
+    {
+        const size_type found = nth_codepoint(codepoint);
+        if (found == npos) {
+            throw std::out_of_range("code point out of range");
+        }
+        return found;
+    }
+
+    // Zero-based column of byte offset `byte` in code points, counted from the start of its line.
+    // With both the line and code point index enabled this no longer scans the line at all
+    [[nodiscard]] size_type column(size_type byte) const
+        requires(sizeof(CharT) == 1)
+    {
+        if (byte > size()) {
+            throw std::out_of_range("index out of range");
+        }
+
+        size_type line_begin = 0;
+        if (lineIndex) {
+            line_begin = line_start(line_of(byte));
+        } else if (const size_type newline = last_before(CharT('\n'), byte); newline != npos) {
+            line_begin = newline + 1;
+        }
+        return codepoints_before(byte) - codepoints_before(line_begin);
+    }
+
+    // Move the gap by `distance` code points, to the start of a code point. Negative values move
+    // it left. Only the bytes passed over are scanned, and if there are not enough code points
+    // in that direction the gap is left where it was and std::out_of_range is thrown
+    constexpr void move_gap_codepoints(difference_type distance)
+        requires(sizeof(CharT) == 1)
+    {
+        if (distance == 0) {
+            return;
+        }
+
+        size_type to = npos;
+        if (distance > 0) {
+            // The end of the buffer counts as the start of one more code point
+            size_type n = static_cast<size_type>(distance) - 1;
+            to = (pos() < size()) ? lead_from(pos() + 1, n) : npos;
+            if (to == npos && n == 0 && pos() < size()) {
+                to = size();
+            }
+        } else {
+            size_type n = static_cast<size_type>(-distance) - 1;
+            to = lead_before(pos(), n);
+        }
+
+        if (to == npos) {
+            throw std::out_of_range("Cannot move gap past the ends of the buffer");
+        }
+        move_gap_to(to);
+    }
+
+    // Keep a running code point count every codepoint_grain bytes on both sides of the gap, so
+    // codepoint_offset(), byte_offset() and column() scan at most one grain. This is what keeps
+    // very long lines, such as minified files, responsive. Like the line index it is only kept
+    // up to date by the modifiers, and not by writes through references to values
+    void enable_codepoint_index()
+        requires(sizeof(CharT) == 1)
+    {
+        if (!codepointIndex) {
+            codepointIndex = std::make_unique<CodepointIndex>(alloc);
+            index_codepoints();
+        }
+    }
+
+    void disable_codepoint_index() noexcept { codepointIndex.reset(); }
+
+    [[nodiscard]] bool has_codepoint_index() const noexcept { return codepointIndex != nullptr; }
+
+    // Undo journal
+    // Record the edits made through the modifiers so that they can be undone and redone. Values
+    // typed or deleted one after another at the same spot are merged into a single step. Once
+    // the journal holds more than `limit` inserted and erased values the oldest steps are
+    // dropped. clear() forgets every step, and as with the line index writes made through
+    // references to values are not seen
+    void enable_undo(size_type limit = size_type(1) << 20) {
+        if (journal) {
+            journal->limit = limit;
+            trim_journal();
+            return;
+        }
+        journal = std::make_unique<Journal>(limit, alloc);
+    }
+
+    void disable_undo() noexcept { journal.reset(); }
+
+    [[nodiscard]] bool has_undo() const noexcept { return journal != nullptr; }
+    [[nodiscard]] bool can_undo() const noexcept { return journal && journal->applied != 0; }
+    [[nodiscard]] bool can_redo() const noexcept {
+        return journal && journal->applied != journal->records.size();
+    }
+
+    // Start a new step with the next edit, even if it continues the current one
+    void undo_boundary() noexcept {
+        if (journal) {
+            journal->boundary = true;
+        }
+    }
+
+    // Revert the most recent step, leaving the gap where it was made. Each record costs a move
+    // of the gap plus the size of the edit. Returns false if there was nothing to undo
+    bool undo() {
+        if (!can_undo()) {
+            return false;
+        }
+
+        Journal& j = *journal;
+        JournalScope replay(&j.replaying);
+        bool chained = true;
+        while (chained) {
+            const JournalRecord record = j.records[j.applied - 1];
+            if (record.erased) {
+                move_gap_to(record.pos);
+                insert_reversed(j.log.data() + record.offset, record.length);
+            } else {
+                move_gap_to(record.pos + record.length);
+                erase(record.length);
+            }
+            j.applied--;
+            chained = record.chained;
+        }
+        j.boundary = true;
+        return true;
+    }
+
+    // Make the most recently undone step again. Returns false if there was nothing to redo
+    bool redo() {
+        if (!can_redo()) {
+            return false;
+        }
+
+        Journal& j = *journal;
+        JournalScope replay(&j.replaying);
+        do {
+            const JournalRecord record = j.records[j.applied];
+            if (record.erased) {
+                move_gap_to(record.pos + record.length);
+                erase(record.length);
+            } else {
+                move_gap_to(record.pos);
+                insert(string_view_type(j.log.data() + record.offset, record.length));
+            }
+            j.applied++;
+        } while (j.applied != j.records.size() && j.records[j.applied].chained);
+        j.boundary = true;
+        return true;
+    }
+
     // Modifiers
-    constexpr void clear() noexcept {
-        std::destroy_n(bufferStart, capacity());
+    // Values that own resources are reset so that the gap does not hold on to them
+    constexpr void clear() noexcept(std::is_nothrow_default_constructible_v<CharT> &&
+                                    std::is_nothrow_move_assignable_v<CharT>) {
+        if (sharedStorage) [[unlikely]] {
+            // Snapshots may still be reading the values, start over in inline storage instead
+            release();
+            bufferStart = acquire_storage(inline_capacity);
+            bufferEnd = bufferStart + inline_capacity;
+        } else if constexpr (!std::is_trivially_destructible_v<CharT>) {
+            std::fill(bufferStart, gapStart, CharT());
+            std::fill(gapEnd, bufferEnd, CharT());
+        }
         gapStart = bufferStart;
         gapEnd = bufferEnd;
+
+        if (lineIndex) {
+            lineIndex->before.clear();
+            lineIndex->after.clear();
+        }
+        if (codepointIndex) {
+            codepointIndex->before.clear();
+            codepointIndex->after.clear();
+        }
+        if (journal) {
+            journal->records.clear();
+            journal->log.clear();
+            journal->applied = 0;
+            journal->boundary = true;
+        }
     }
 
-    constexpr void insert(const std::string_view value) {
-        for (auto&& c : value) {
-            push_back(c);
+    // Insert at the gap. Capacity is checked once up front and grown a single time to fit the
+    // whole value, which is then block copied into the gap
+    constexpr void insert(const string_view_type value) {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::insert);
+        statsData.edits++;
+#endif
+        if (value.size() >= gap_size()) {
+            reserve(Growth::grow(capacity(), size() + value.size()));
+        }
+        before_write(gapStart, gapStart + value.size());
+
+        if (journal) [[unlikely]] {
+            journal_edit(false, pos(), value.data(), value.size());
+        }
+        if (lineIndex) [[unlikely]] {
+            index_inserted(value);
+        }
+        gapStart = std::copy(value.begin(), value.end(), gapStart);
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
         }
     }
 
-    // Intentionally discardable
-    constexpr std::string erase(size_type count) {
-        std::string ret = "";
+    constexpr void insert(size_type loc, const string_view_type value) {
+        move_gap_to(loc);
+        insert(value);
+    }
 
-        for (unsigned int i = 0; i < count; i++) {
-            ret.push_back(pop_back());
+    // Streaming ingest
+    // Append values that arrive in pieces, e.g. from a pipe or socket, without collecting them
+    // first. Each call moves the gap to the end, which is free while nothing else is edited
+    // between chunks, and reads straight into it. The buffer stays usable between calls
+    constexpr void append_chunk(std::span<const CharT> chunk) {
+        move_gap_to(size());
+        insert(string_view_type(chunk.data(), chunk.size()));
+    }
+
+    // Read everything left in `is` into the end of the buffer, a gap's worth at a time. Returns
+    // the number of values read. `is` is left at end of file, as after any short read()
+    size_type read_from(std::basic_istream<CharT>& is) {
+        size_type total = 0;
+        while (is) {
+            total += read_into_gap([&](CharT* first, size_type room) {
+                is.read(first, static_cast<std::streamsize>(room));
+                return static_cast<size_type>(is.gcount());
+            });
         }
+        return total;
+    }
 
-        return ret;
+#ifdef GAPBUFFER_HAS_WRITEV
+    // Read whatever `fd` has ready with a single read() into the gap at the end of the buffer.
+    // Returns the number of values read, or 0 at end of input. EINTR is retried, anything else,
+    // including EAGAIN from a non-blocking descriptor, throws std::system_error
+    size_type read_some(int fd)
+        requires(sizeof(CharT) == 1)
+    {
+        return read_into_gap([&](CharT* first, size_type room) {
+            ::ssize_t got;
+            do {
+                got = ::read(fd, first, room);
+            } while (got == -1 && errno == EINTR);
+
+            if (got == -1) {
+                throw std::system_error(errno, std::generic_category(), "read failed");
+            }
+            return static_cast<size_type>(got);
+        });
     }
 
-    constexpr void push_back(const char& value) {
-        *gapStart = value;
-        gapStart++;
-        if (gapStart == gapEnd) {
-            reserve(capacity() * 2);
+    // Read from `fd` until end of input. Returns the number of values read
+    size_type read_from(int fd)
+        requires(sizeof(CharT) == 1)
+    {
+        size_type total = 0;
+        while (const size_type got = read_some(fd)) {
+            total += got;
         }
+        return total;
     }
+#endif
+
+    // Remove `count` values to the left of the gap by widening it. Nothing is copied: the
+    // returned view points at the removed values, which now sit at the start of the gap, and
+    // is only valid until the next modification of the buffer. Intentionally discardable
+    constexpr string_view_type erase(size_type count) {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::erase);
+        statsData.edits++;
+#endif
+        if (count > pos()) {
+            throw std::out_of_range("Cannot erase more values than precede the gap");
+        }
+
+        if (journal) [[unlikely]] {
+            journal_edit(true, pos() - count, gapStart - count, count);
+        }
+        if (lineIndex) [[unlikely]] {
+            index_erased(pos() - count);
+        }
+
+        gapStart -= count;
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
+        }
+        return string_view_type(gapStart, count);
+    }
+
+    // As above, but the removed values are first copied into `out`, which must be able to hold
+    // `count` values. Returns the part of `out` that was written to
+    constexpr std::span<CharT> erase(size_type count, std::span<CharT> out) {
+        if (out.size() < count) {
+            throw std::length_error("Output span too small to hold the erased values");
+        }
+
+        const string_view_type removed = erase(count);
+        std::copy(removed.begin(), removed.end(), out.begin());
+        return out.first(count);
+    }
+
+    constexpr void push_back(const CharT& value) { push_value(value); }
+    constexpr void push_back(CharT&& value) { push_value(std::move(value)); }
 
     // Intentionally discardable
-    constexpr char pop_back() {
+    constexpr CharT pop_back() {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::pop_back);
+        statsData.edits++;
+#endif
         if (gapStart == bufferStart) {
             throw std::out_of_range("Buffer is empty");
         }
 
-        const char ret = *(gapStart - 1);
-        std::destroy_at(gapStart);
+        if (journal) [[unlikely]] {
+            journal_edit(true, pos() - 1, gapStart - 1, 1);
+        }
+
+        // Moving out may change the value left behind, which snapshots could still see
+        if constexpr (!std::is_trivially_copyable_v<CharT>) {
+            before_write(gapStart - 1, gapStart);
+        }
+        CharT ret = std::move(*(gapStart - 1));
+        if (lineIndex && is_newline(ret)) [[unlikely]] {
+            lineIndex->before.pop_back();
+        }
+
         gapStart -= 1;
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
+        }
         return ret;
     }
 
+    // Move the gap one position to the right. Does nothing if the gap is already at the end
     constexpr void advance() {
-        if (gap_size() == 0) {
+        if (gapEnd == bufferEnd) {
             return;
         }
-        std::optional<char> c = std::nullopt;
+        move_gap(1);
+    }
 
-        if (gapEnd < bufferEnd) {
-            c = *gapEnd;
-            std::destroy_at(gapEnd);
+    // Move the gap one position to the left. Does nothing if the gap is already at the start
+    constexpr void retreat() {
+        if (gapStart == bufferStart) {
+            return;
         }
+        move_gap(-1);
+    }
 
-        gapEnd++;
-        if (c.has_value()) {
-            *gapStart = c.value();
+    // Relocate the gap so that it starts at logical position `loc`. All values between the old
+    // and new gap position are shifted across the gap in a single block move (memmove for
+    // trivially copyable types) so the cost is O(distance) with no per-character overhead
+    constexpr void move_gap_to(size_type loc) {
+        if (loc > size()) {
+            throw std::out_of_range("Cannot move gap past the end of the buffer");
+        }
+
+        const size_type current = pos();
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::move_gap);
+        if (loc != current) {
+            const size_type distance = (loc < current) ? current - loc : loc - current;
+            statsData.gap_moves++;
+            statsData.gap_distance += distance;
+            statsData.bytes_moved += distance * sizeof(CharT);
+        }
+#endif
+        if (lineIndex) [[unlikely]] {
+            index_moved(current, loc);
+        }
+
+        if (loc < current) {
+            const size_type count = current - loc;
+            before_write(gapEnd - count, gapEnd);
+            std::copy_backward(gapStart - count, gapStart, gapEnd);
+            gapStart -= count;
+            gapEnd -= count;
+        } else if (loc > current) {
+            const size_type count = loc - current;
+            before_write(gapStart, gapStart + count);
+            std::copy(gapEnd, gapEnd + count, gapStart);
+            gapStart += count;
+            gapEnd += count;
+        }
+
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
         }
-        gapStart++;
     }
 
-    constexpr void retreat() {
-        if (gap_size() == 0) {
+    // Relocate the gap relative to its current position. Negative values move it left
+    constexpr void move_gap(difference_type distance) {
+        if (distance < 0 && static_cast<size_type>(-distance) > pos()) {
+            throw std::out_of_range("Cannot move gap before the start of the buffer");
+        }
+        move_gap_to(pos() + distance);
+    }
+
+    // Apply every edit of a multi-cursor operation at once and leave the gap at `cursor`, an
+    // offset into the edited buffer. `edits` must be sorted by position and must not overlap.
+    // When the result fits the current capacity the edits are made in place, back to front in a
+    // single sweep of the gap. Otherwise rather than growing part way through, the result is
+    // built in one pass into one new allocation. Invalid edits are rejected before anything is
+    // changed. If a value throws while being copied, the single pass leaves the buffer as it was.
+    // The in-place sweep, taken for inline buffers and with the journal enabled too, makes one
+    // edit at a time, so a value that throws or the journal or line index failing to allocate
+    // leaves the edits after the failing one made and the rest not
+    constexpr void apply_batch(std::span<const Edit> edits, size_type cursor) {
+        size_type new_size = size();
+        size_type prev_end = 0;
+        for (const Edit& edit : edits) {
+            if (edit.pos < prev_end) {
+                throw std::invalid_argument("Batched edits must be sorted and must not overlap");
+            }
+            if (edit.pos > size() || edit.erase_count > size() - edit.pos) {
+                throw std::out_of_range("Batched edit past the end of the buffer");
+            }
+            prev_end = edit.pos + edit.erase_count;
+            new_size += edit.text.size() - edit.erase_count;
+        }
+        if (cursor > new_size) {
+            throw std::out_of_range("Cannot move gap past the end of the buffer");
+        }
+
+        // Largest size reached while editing back to front
+        size_type peak = size();
+        size_type running = size();
+        for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+            running = running - it->erase_count + it->text.size();
+            peak = std::max(peak, running);
+        }
+
+        // Inline buffers are too small for the single pass to pay off, and share their storage
+        // with the result. With the journal enabled the edits are recorded one by one, as a
+        // single step
+        if (peak < capacity() || is_inline() || journal) {
+            if (peak >= capacity()) {
+                reserve(Growth::grow(capacity(), peak));
+            }
+            if (journal) [[unlikely]] {
+                journal->boundary = true;
+                journal->chain = false;
+            }
+            {
+                JournalScope batch(journal ? &journal->batching : nullptr);
+                for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+                    move_gap_to(it->pos + it->erase_count);
+                    erase(it->erase_count);
+                    insert(it->text);
+                }
+            }
+            if (journal) [[unlikely]] {
+                journal->boundary = true;
+                journal->chain = false;
+                trim_journal();
+            }
+            move_gap_to(cursor);
             return;
         }
-        std::optional<char> c = std::nullopt;
 
-        gapStart--;
-        if (gapStart > bufferStart) {
-            c = *gapStart;
-            std::destroy_at(gapStart);
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::reallocate);
+        statsData.reallocations++;
+        statsData.bytes_reallocated += size() * sizeof(CharT);
+        statsData.edits += edits.size();
+#endif
+        const size_type new_cap = Growth::grow(capacity(), new_size);
+        pointer new_mem = acquire_storage(new_cap);
+        pointer new_end = new_mem + new_cap;
+        const size_type rhs_size = new_size - cursor;
+
+        // Output offsets before `cursor` go to the left half and the rest to the right half
+        size_type out = 0;
+        auto emit = [&](const CharT* first, size_type len) {
+            if (out < cursor) {
+                const size_type lhs_len = std::min(len, cursor - out);
+                std::copy_n(first, lhs_len, new_mem + out);
+                first += lhs_len;
+                len -= lhs_len;
+                out += lhs_len;
+            }
+            if (len == 0) {
+                return;  // the chunk ended left of the cursor
+            }
+            std::copy_n(first, len, new_end - rhs_size + (out - cursor));
+            out += len;
+        };
+        const auto [lhs, rhs] = segments();
+        auto emit_range = [&](size_type first, size_type last) {
+            if (first < lhs.size()) {
+                const size_type stop = std::min(last, lhs.size());
+                emit(lhs.data() + first, stop - first);
+                first = stop;
+            }
+            if (first < last) {
+                emit(rhs.data() + (first - lhs.size()), last - first);
+            }
+        };
+
+        try {
+            size_type in = 0;
+            for (const Edit& edit : edits) {
+                emit_range(in, edit.pos);
+                emit(edit.text.data(), edit.text.size());
+                in = edit.pos + edit.erase_count;
+            }
+            emit_range(in, size());
+        } catch (...) {
+            std::destroy(new_mem, new_end);
+            alloc_traits::deallocate(alloc, new_mem, new_cap);
+            throw;
         }
 
-        gapEnd--;
-        if (c.has_value()) {
-            *gapEnd = c.value();
+        const bool indexed = lineIndex != nullptr;
+        const bool codepoints_indexed = codepointIndex != nullptr;
+        release();
+        bufferStart = new_mem;
+        bufferEnd = new_end;
+        gapStart = new_mem + cursor;
+        gapEnd = new_end - rhs_size;
+
+        if (indexed) {
+            lineIndex.reset();
+            enable_line_index();
+        }
+        if (codepoints_indexed) {
+            codepointIndex->before.clear();
+            codepointIndex->after.clear();
+            index_codepoints();
         }
     }
 
    private:
+    // push_back() for both copies and moves. A value that the journal or line index has to look
+    // at is only moved from once they have
+    template <typename Value>
+    constexpr void push_value(Value&& value) {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::push_back);
+        statsData.edits++;
+#endif
+        // The gap can only be empty for a freshly mapped file or a moved-from buffer
+        if (gapStart == gapEnd) [[unlikely]] {
+            reserve(Growth::grow(capacity(), size()));
+        }
+        before_write(gapStart, gapStart + 1);
+
+        if (journal) [[unlikely]] {
+            journal_edit(false, pos(), &value, 1);
+        }
+        if (lineIndex && is_newline(value)) [[unlikely]] {
+            lineIndex->before.push_back(pos());
+        }
+
+        *gapStart = std::forward<Value>(value);
+        gapStart++;
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
+        }
+        if (gapStart == gapEnd) {
+            reserve(Growth::grow(capacity(), size()));
+        }
+    }
+
+    // Trivial values in the gap are never read before being overwritten, so their storage is
+    // left uninitialized instead of paying for a write pass over the whole allocation
+    constexpr pointer allocate_storage(size_type n) {
+        pointer mem = alloc_traits::allocate(alloc, n);
+        if constexpr (!std::is_trivially_default_constructible_v<CharT>) {
+            try {
+                std::uninitialized_value_construct_n(mem, n);
+            } catch (...) {
+                alloc_traits::deallocate(alloc, mem, n);
+                throw;
+            }
+        }
+        return mem;
+    }
+
+    struct empty_tag {};
+
+    // A buffer without any storage, the state moved-from buffers are left in
+    constexpr BasicGapbuffer(empty_tag, const Allocator& allocator) noexcept
+        : alloc(allocator),
+          bufferStart(nullptr),
+          gapStart(nullptr),
+          gapEnd(nullptr),
+          bufferEnd(nullptr) {}
+
+    // Take over the contents of `other` and leave it without storage. This buffer must not hold
+    // any storage of its own. Inline values have to be moved, but there are few enough of them
+    // that this stays constant time
+    constexpr void steal(BasicGapbuffer& other) noexcept(
+        std::is_nothrow_move_constructible_v<CharT>) {
+        if (other.is_inline()) {
+            bufferStart = inlineStorage;
+            bufferEnd = std::uninitialized_move(other.bufferStart, other.bufferEnd, inlineStorage);
+            gapStart = bufferStart + (other.gapStart - other.bufferStart);
+            gapEnd = bufferStart + (other.gapEnd - other.bufferStart);
+            std::destroy(other.bufferStart, other.bufferEnd);
+        } else {
+            bufferStart = other.bufferStart;
+            gapStart = other.gapStart;
+            gapEnd = other.gapEnd;
+            bufferEnd = other.bufferEnd;
+        }
+
+        other.bufferStart = other.gapStart = other.gapEnd = other.bufferEnd = nullptr;
+        mappedLength = std::exchange(other.mappedLength, 0);
+        mappedAnonymous = std::exchange(other.mappedAnonymous, false);
+        lineIndex = std::move(other.lineIndex);
+        codepointIndex = std::move(other.codepointIndex);
+        journal = std::move(other.journal);
+        sharedStorage = std::move(other.sharedStorage);
+        frozenStart = std::exchange(other.frozenStart, nullptr);
+        frozenEnd = std::exchange(other.frozenEnd, nullptr);
+    }
+
+    // Storage for `n` values, inside the object when they fit. Inline storage is small enough
+    // that value initializing it costs next to nothing
+    constexpr pointer acquire_storage(size_type n) {
+        if (n > inline_capacity) {
+            return allocate_storage(n);
+        }
+        std::uninitialized_value_construct_n(inlineStorage, n);
+        return inlineStorage;
+    }
+
+#ifdef GAPBUFFER_HAS_MMAP
+    // Adopt a mapping made by from_file(). The gap starts out empty at the end of the file
+    BasicGapbuffer(pointer mem, size_type length, const Allocator& allocator)
+        : alloc(allocator),
+          bufferStart(mem),
+          gapStart(mem + length),
+          gapEnd(mem + length),
+          bufferEnd(mem + length),
+          mappedLength(length) {}
+#endif
+
+    // Offsets of every newline, split at the gap the same way as the values so that edits at the
+    // gap never have to renumber anything. Newlines left of the gap are stored as offsets from
+    // the start and newlines right of it as distances from the end. In both vectors the entries
+    // nearest to the gap are at the back
+    struct LineIndex {
+        using vector_type =
+            std::vector<size_type, typename alloc_traits::template rebind_alloc<size_type>>;
+
+        explicit LineIndex(const Allocator& allocator) : before(allocator), after(allocator) {}
+
+        vector_type before;
+        vector_type after;
+    };
+
+    // Only character types have lines, for any other value type the line index stays empty
+    static constexpr bool is_newline(const CharT& value) noexcept {
+        if constexpr (gapbuffer_detail::is_character_v<CharT>) {
+            return value == CharT('\n');
+        } else {
+            return false;
+        }
+    }
+
+    void index_inserted(string_view_type value) {
+        const size_type at = pos();
+        for (size_type i = 0; i < value.size(); i++) {
+            if (is_newline(value[i])) {
+                lineIndex->before.push_back(at + i);
+            }
+        }
+    }
+
+    void index_erased(size_type new_pos) noexcept {
+        auto& before = lineIndex->before;
+        while (!before.empty() && before.back() >= new_pos) {
+            before.pop_back();
+        }
+    }
+
+    void index_moved(size_type from, size_type to) {
+        auto& [before, after] = *lineIndex;
+        const size_type len = size();
+
+        if (to > from) {
+            while (!after.empty() && len - after.back() < to) {
+                before.push_back(len - after.back());
+                after.pop_back();
+            }
+        } else {
+            while (!before.empty() && before.back() >= to) {
+                after.push_back(len - before.back());
+                before.pop_back();
+            }
+        }
+    }
+
+    struct JournalRecord {
+        size_type pos;     // Start of the inserted values, or where the erased ones were
+        size_type length;
+        size_type offset;  // Of the values in the log
+        bool erased;
+        bool chained;  // Undone and redone together with the record before it
+    };
+
+    // Edits recorded for undo(). The values of every record live in one append-only log, so
+    // recording an edit allocates nothing of its own once the vectors have grown. Erased values
+    // are logged back to front, which lets a run of backspaces keep extending one record at the
+    // end of the log
+    struct Journal {
+        using record_vector = std::vector<
+            JournalRecord,
+            typename alloc_traits::template rebind_alloc<JournalRecord>>;
+
+        Journal(size_type max_values, const Allocator& allocator)
+            : records(allocator), log(allocator), limit(max_values) {}
+
+        record_vector records;
+        std::vector<CharT, Allocator> log;
+        size_type applied = 0;  // Records before this one are undoable, the rest can be redone
+        size_type limit;
+        bool boundary = true;  // The next edit starts a new record
+        bool replaying = false;
+        bool batching = false;
+        bool chain = false;  // New records belong to the step of the record before them
+    };
+
+    // Sets a flag of the journal while in scope, when there is a journal
+    struct JournalScope {
+        constexpr explicit JournalScope(bool* scoped) noexcept : flag(scoped) {
+            if (flag) {
+                *flag = true;
+            }
+        }
+        constexpr ~JournalScope() {
+            if (flag) {
+                *flag = false;
+            }
+        }
+        JournalScope(const JournalScope&) = delete;
+        JournalScope& operator=(const JournalScope&) = delete;
+
+        bool* flag;
+    };
+
+    // Record the edit of `len` values at `at`, which are about to be inserted or erased
+    void journal_edit(bool erased, size_type at, const CharT* values, size_type len) {
+        Journal& j = *journal;
+        if (j.replaying || len == 0) {
+            return;
+        }
+
+        // A new edit replaces whatever could have been redone
+        if (j.applied != j.records.size()) {
+            j.records.erase(j.records.begin() + j.applied, j.records.end());
+            const size_type used =
+                j.records.empty() ? 0 : j.records.back().offset + j.records.back().length;
+            j.log.erase(j.log.begin() + used, j.log.end());
+            j.boundary = true;
+        }
+
+        JournalRecord* last = (j.boundary || j.records.empty()) ? nullptr : &j.records.back();
+        const bool extends = last && last->erased == erased &&
+                             last->offset + last->length == j.log.size() &&
+                             (erased ? last->pos == at + len : last->pos + last->length == at);
+
+        const size_type offset = j.log.size();
+        if (erased) {
+            j.log.insert(j.log.end(), std::make_reverse_iterator(values + len),
+                         std::make_reverse_iterator(values));
+        } else {
+            j.log.insert(j.log.end(), values, values + len);
+        }
+
+        if (extends) {
+            last->length += len;
+            if (erased) {
+                last->pos = at;
+            }
+        } else {
+            j.records.push_back({at, len, offset, erased, j.chain});
+            j.chain = j.batching;
+        }
+        j.applied = j.records.size();
+        j.boundary = false;
+
+        if (!j.batching) {
+            trim_journal();
+        }
+    }
+
+    // Drop the oldest steps once the log outgrows its limit. Whole steps are dropped until half
+    // the limit is left, so moving what remains is paid for by the values logged since the last
+    // trim. The newest step is kept, however large
+    void trim_journal() {
+        Journal& j = *journal;
+        if (j.log.size() <= j.limit || j.records.empty()) {
+            return;
+        }
+
+        // Steps that can still be redone are never dropped either
+        size_type newest = j.records.size() - 1;
+        while (newest > 0 && j.records[newest].chained) {
+            newest--;
+        }
+        const size_type stop = std::min(newest, j.applied);
+
+        size_type drop = 0;
+        while (drop < stop && j.log.size() - j.records[drop].offset > j.limit / 2) {
+            do {
+                drop++;
+            } while (drop < stop && j.records[drop].chained);
+        }
+        if (drop == 0) {
+            return;
+        }
+
+        const size_type cut = j.records[drop].offset;
+        j.log.erase(j.log.begin(), j.log.begin() + cut);
+        j.records.erase(j.records.begin(), j.records.begin() + drop);
+        for (JournalRecord& record : j.records) {
+            record.offset -= cut;
+        }
+        j.applied -= drop;
+    }
+
+    // Code point index
+    // before[i] is the number of code points in the first (i + 1) grains of the buffer and
+    // after[i] the number in its last (i + 1) grains, for every grain that lies wholly on that
+    // side of the gap. Edits at the gap only ever drop or append entries at the back
+    using CodepointIndex = LineIndex;
+    static constexpr size_type codepoint_grain = 4096;
+
+    void index_codepoints() {
+        auto& [before, after] = *codepointIndex;
+        const size_type left = pos();
+        const size_type right = size() - pos();
+
+        while (before.size() * codepoint_grain > left) {
+            before.pop_back();
+        }
+        while (after.size() * codepoint_grain > right) {
+            after.pop_back();
+        }
+        while ((before.size() + 1) * codepoint_grain <= left) {
+            const size_type start = before.size() * codepoint_grain;
+            before.push_back((before.empty() ? 0 : before.back()) +
+                             codepoints_in(start, start + codepoint_grain));
+        }
+        while ((after.size() + 1) * codepoint_grain <= right) {
+            const size_type end = size() - after.size() * codepoint_grain;
+            after.push_back((after.empty() ? 0 : after.back()) +
+                            codepoints_in(end - codepoint_grain, end));
+        }
+    }
+
+    // Number of code points that start in the logical range [first, last)
+    [[nodiscard]] size_type codepoints_in(size_type first, size_type last) const noexcept {
+        const auto [lhs, rhs] = segments();
+        size_type ret = 0;
+        if (first < lhs.size()) {
+            ret += gapbuffer_detail::count_codepoints(
+                lhs.data() + first, std::min(last, lhs.size()) - first);
+        }
+        if (last > lhs.size()) {
+            const size_type from = std::max(first, lhs.size()) - lhs.size();
+            ret += gapbuffer_detail::count_codepoints(rhs.data() + from, last - lhs.size() - from);
+        }
+        return ret;
+    }
+
+    // Number of code points that start in [from, size()), for `from` at or after the gap
+    [[nodiscard]] size_type codepoints_after(size_type from) const noexcept {
+        const auto& after = codepointIndex->after;
+        const size_type grains = (size() - from) / codepoint_grain;
+        return (grains == 0 ? 0 : after[grains - 1]) +
+               codepoints_in(from, size() - grains * codepoint_grain);
+    }
+
+    [[nodiscard]] size_type codepoints_before(size_type byte) const noexcept {
+        if (!codepointIndex) {
+            return codepoints_in(0, byte);
+        }
+
+        if (byte <= pos()) {
+            const auto& before = codepointIndex->before;
+            const size_type grains = byte / codepoint_grain;
+            return (grains == 0 ? 0 : before[grains - 1]) +
+                   codepoints_in(grains * codepoint_grain, byte);
+        }
+        return codepoints_before(pos()) + codepoints_after(pos()) - codepoints_after(byte);
+    }
+
+    static constexpr bool is_codepoint_start(CharT c) noexcept {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    }
+
+    // Offset of the zero-based `n`th code point starting at or after `first`. Returns npos if
+    // there are fewer, in which case `n` is reduced by the number that were seen. Whole blocks
+    // are skipped using the counting kernel, like find_nth_value()
+    [[nodiscard]] size_type lead_from(size_type first, size_type& n) const noexcept {
+        constexpr size_type block = 4096;
+
+        for (size_type i = first; i < size(); i += block) {
+            const size_type found = codepoints_in(i, std::min(size(), i + block));
+            if (found <= n) {
+                n -= found;
+                continue;
+            }
+
+            for (size_type j = i;; j++) {
+                if (is_codepoint_start((*this)[j]) && n-- == 0) {
+                    return j;
+                }
+            }
+        }
+        return npos;
+    }
+
+    // As above, but for the `n`th code point counting back from the one before `last`
+    [[nodiscard]] size_type lead_before(size_type last, size_type& n) const noexcept {
+        constexpr size_type block = 4096;
+
+        for (size_type i = last; i > 0;) {
+            const size_type start = i - std::min(i, block);
+            const size_type found = codepoints_in(start, i);
+            if (found <= n) {
+                n -= found;
+                i = start;
+                continue;
+            }
+
+            for (size_type j = i; j-- > start;) {
+                if (is_codepoint_start((*this)[j]) && n-- == 0) {
+                    return j;
+                }
+            }
+        }
+        return npos;
+    }
+
+    // Offset of the last `value` before `last`, or npos. Blocks without one are skipped by the
+    // counting kernel, so a long line is not walked back one value at a time
+    [[nodiscard]] size_type last_before(CharT value, size_type last) const noexcept {
+        constexpr size_type block = 4096;
+
+        for (size_type i = last; i > 0;) {
+            const size_type start = i - std::min(i, block);
+            if (count_range(start, i, value) != 0) {
+                while ((*this)[--i] != value) {
+                }
+                return i;
+            }
+            i = start;
+        }
+        return npos;
+    }
+
+    // Byte offset of the zero-based code point `codepoint`, size() one past the last, otherwise
+    // npos. The index narrows the search down to a single grain on either side of the gap
+    [[nodiscard]] size_type nth_codepoint(size_type codepoint) const noexcept {
+        size_type n = codepoint;
+        if (!codepointIndex) {
+            const size_type found = lead_from(0, n);
+            return (found == npos && n == 0) ? size() : found;
+        }
+
+        const auto& [before, after] = *codepointIndex;
+        const size_type left = codepoints_before(pos());
+        if (codepoint < left) {
+            const size_type grain =
+                std::upper_bound(before.begin(), before.end(), codepoint) - before.begin();
+            n = codepoint - (grain == 0 ? 0 : before[grain - 1]);
+            return lead_from(grain * codepoint_grain, n);
+        }
+
+        const size_type right = codepoints_after(pos());
+        if (codepoint - left >= right) {
+            return (codepoint - left == right) ? size() : npos;
+        }
+
+        // Code points from the wanted one to the end, found in the fewest trailing grains
+        const size_type remaining = left + right - codepoint;
+        const size_type grain =
+            std::lower_bound(after.begin(), after.end(), remaining) - after.begin();
+        if (grain < after.size()) {
+            n = after[grain] - remaining;
+            return lead_from(size() - (grain + 1) * codepoint_grain, n);
+        }
+        n = codepoint - left;
+        return lead_from(pos(), n);
+    }
+
+    // Smallest gap a streaming read is offered. Once the gap runs lower the buffer grows through
+    // Growth, so reads stay large and the number of reallocations logarithmic in the input
+    static constexpr size_type read_chunk = 64 * 1024;
+
+    // Move the gap to the end and let `read(first, room)` fill up to `room` values from `first`,
+    // returning how many it wrote. The values it wrote are then taken into the buffer
+    template <typename ReadFn>
+    size_type read_into_gap(ReadFn&& read) {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::insert);
+        statsData.edits++;
+#endif
+        move_gap_to(size());
+        if (gap_size() < read_chunk) {
+            reserve(Growth::grow(capacity(), size() + read_chunk));
+        }
+        before_write(gapStart, gapEnd);
+
+        const size_type got = read(gapStart, gap_size());
+        if (got == 0) {
+            return 0;
+        }
+        if (journal) [[unlikely]] {
+            journal_edit(false, pos(), gapStart, got);
+        }
+        if (lineIndex) [[unlikely]] {
+            index_inserted(string_view_type(gapStart, got));
+        }
+        gapStart += got;
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
+        }
+        return got;
+    }
+
+    // Insert `len` values at the gap that are stored back to front from `first`
+    void insert_reversed(const CharT* first, size_type len) {
+        if (len >= gap_size()) {
+            reserve(Growth::grow(capacity(), size() + len));
+        }
+        before_write(gapStart, gapStart + len);
+
+        std::reverse_copy(first, first + len, gapStart);
+        if (lineIndex) [[unlikely]] {
+            index_inserted(string_view_type(gapStart, len));
+        }
+        gapStart += len;
+        if (codepointIndex) [[unlikely]] {
+            index_codepoints();
+        }
+    }
+
+    // Offset of the zero-based `n`th newline, or npos if there are not that many
+    [[nodiscard]] size_type nth_newline(size_type n) const {
+        if (lineIndex) {
+            const auto& [before, after] = *lineIndex;
+            if (n < before.size()) {
+                return before[n];
+            }
+            if (n - before.size() < after.size()) {
+                return size() - after[after.size() - 1 - (n - before.size())];
+            }
+            return npos;
+        }
+
+        return find_nth(CharT('\n'), n + 1);
+    }
+
+    template <typename Fn, typename Span>
+    static constexpr bool visit_segment(Fn& fn, Span segment) {
+        if (segment.empty()) {
+            return true;
+        }
+        if constexpr (std::is_same_v<std::invoke_result_t<Fn&, Span>, bool>) {
+            return std::invoke(fn, segment);
+        } else {
+            std::invoke(fn, segment);
+            return true;
+        }
+    }
+
+    // Offset one past the newline ending the line that starts at `start`, or size(). Lines are
+    // short next to the blocks find_nth_from() counts in, so this stops at the first newline
+    [[nodiscard]] size_type line_end(size_type start) const noexcept {
+        const auto [left, right] = string_segments();
+        if (start < left.size()) {
+            if (const size_type found = left.find(CharT('\n'), start); found != npos) {
+                return found + 1;
+            }
+            start = left.size();
+        }
+        const size_type found = right.find(CharT('\n'), start - left.size());
+        return (found == npos) ? size() : left.size() + found + 1;
+    }
+
+    // Offset at which line `line_number` starts, or size() for the one past the last line
+    [[nodiscard]] size_type line_offset(size_type line_number) const {
+        if (line_number == 0) {
+            return 0;
+        }
+        if (const size_type newline = nth_newline(line_number - 1); newline != npos) {
+            return newline + 1;
+        }
+        if (line_number == line_count()) {
+            return size();
+        }
+        throw std::out_of_range("line number out of range");
+    }
+
+    [[nodiscard]] LineView view_of(size_type first, size_type last) const noexcept {
+        const size_type left = pos();
+        LineView ret;
+        ret.start = first;
+        if (first < left) {
+            ret.left = string_view_type(bufferStart + first, std::min(last, left) - first);
+        }
+        if (last > left) {
+            const size_type from = std::max(first, left) - left;
+            ret.right = string_view_type(gapEnd + from, last - left - from);
+        }
+        return ret;
+    }
+
+    [[nodiscard]] std::pair<string_view_type, string_view_type> string_segments() const noexcept {
+        const auto [lhs, rhs] = segments();
+        return {string_view_type(lhs.data(), lhs.size()), string_view_type(rhs.data(), rhs.size())};
+    }
+
+    // Whether `needle` occurs at `start`, which is before the gap, and runs past the gap
+    [[nodiscard]] bool straddles_match(size_type start, string_view_type needle) const noexcept {
+        const auto [left, right] = string_segments();
+        const size_type in_left = left.size() - start;
+        return in_left < needle.size() && needle.size() - in_left <= right.size() &&
+               left.substr(start) == needle.substr(0, in_left) &&
+               right.substr(0, needle.size() - in_left) == needle.substr(in_left);
+    }
+
+    // Number of occurrences of `value` in the logical range [first, last)
+    [[nodiscard]] size_type count_range(size_type first, size_type last, CharT value)
+        const noexcept {
+        const auto [lhs, rhs] = segments();
+        size_type ret = 0;
+        if (first < lhs.size()) {
+            ret += gapbuffer_detail::count_values(
+                lhs.data() + first, std::min(last, lhs.size()) - first, value);
+        }
+        if (last > lhs.size()) {
+            const size_type from = std::max(first, lhs.size()) - lhs.size();
+            ret += gapbuffer_detail::count_values(
+                rhs.data() + from, last - lhs.size() - from, value);
+        }
+        return ret;
+    }
+
+    // Offset of the zero-based `n`th occurrence of `value` at or after `first`, or npos
+    [[nodiscard]] size_type find_nth_from(size_type first, CharT value, size_type n)
+        const noexcept {
+        const auto [lhs, rhs] = segments();
+        if (first < lhs.size()) {
+            if (auto p = gapbuffer_detail::find_nth_value(
+                    lhs.data() + first, lhs.size() - first, value, n)) {
+                return p - lhs.data();
+            }
+            first = lhs.size();
+        }
+
+        const size_type from = first - lhs.size();
+        if (auto p = gapbuffer_detail::find_nth_value(
+                rhs.data() + from, rhs.size() - from, value, n)) {
+            return lhs.size() + (p - rhs.data());
+        }
+        return npos;
+    }
+
+    static size_type parallel_chunk(const GapbufferParallel& par) noexcept {
+        return std::max<size_type>(par.chunk, 1);
+    }
+
+    // Splitting only pays off once there are at least two chunks and enough data to cover the
+    // cost of starting the threads
+    [[nodiscard]] bool parallel_worthwhile(const GapbufferParallel& par) const noexcept {
+        return size() >= par.min_size && size() > parallel_chunk(par);
+    }
+
+    // Occurrences of `value` in each consecutive chunk of the buffer, counted in parallel. Chunks
+    // are logical ranges, so one of them may straddle the gap
+    [[nodiscard]] std::vector<size_type> chunk_counts(const GapbufferParallel& par,
+                                                      CharT value) const {
+        const size_type chunk = parallel_chunk(par);
+        const unsigned threads =
+            par.threads != 0 ? par.threads : std::max(1u, std::thread::hardware_concurrency());
+
+        std::vector<size_type> counts((size() + chunk - 1) / chunk);
+        gapbuffer_detail::parallel_for(counts.size(), threads, [&](std::size_t i) {
+            counts[i] = count_range(i * chunk, std::min(size(), (i + 1) * chunk), value);
+        });
+        return counts;
+    }
+
+    // Frees storage shared with snapshots once the last of them lets go of it
+    struct SharedStorage {
+        void operator()(void*) noexcept {
+            if (disarmed) {
+                return;
+            }
+            std::destroy_n(mem, capacity);
+#ifdef GAPBUFFER_HAS_MMAP
+            if (mappedLength != 0) {
+                ::munmap(mem, mappedLength);
+                return;
+            }
+#endif
+            alloc_traits::deallocate(alloc, mem, capacity);
+        }
+
+        allocator_type alloc;
+        pointer mem;
+        size_type capacity;
+        size_type mappedLength;
+        bool disarmed;  // Set while the storage is not to be freed, as it has been taken back
+    };
+
+    // Hand ownership of the storage to a reference count that snapshots can take part in
+    void share_storage() {
+        if (sharedStorage) {
+            return;
+        }
+
+        // The deleter runs if the control block cannot be allocated, so it starts out disarmed
+        sharedStorage = std::shared_ptr<void>(
+            std::to_address(bufferStart),
+            SharedStorage{alloc, bufferStart, capacity(), mappedLength, true}, alloc);
+        std::get_deleter<SharedStorage>(sharedStorage)->disarmed = false;
+        mappedLength = 0;
+        frozenStart = gapStart;
+        frozenEnd = gapEnd;
+    }
+
+    // Called before the values in [first, last) are overwritten. Snapshots may read everything
+    // outside [frozenStart, frozenEnd)
+    constexpr void before_write(pointer first, pointer last) {
+        if (sharedStorage && (first < frozenStart || last > frozenEnd)) [[unlikely]] {
+            unshare();
+        }
+    }
+
+    // Get storage that no snapshot can see. If every snapshot is gone the storage is simply
+    // taken back, otherwise the contents are copied
+    void unshare() {
+        if (sharedStorage.use_count() == 1) {
+            // Pairs with the release of the reference by the last snapshot, so that its reads
+            // happen before our writes
+            std::atomic_thread_fence(std::memory_order_acquire);
+            SharedStorage* owner = std::get_deleter<SharedStorage>(sharedStorage);
+            owner->disarmed = true;
+            mappedLength = owner->mappedLength;
+            sharedStorage.reset();
+            frozenStart = frozenEnd = nullptr;
+            return;
+        }
+        reallocate(capacity());
+    }
+
+    // Move the contents into a new allocation of `new_cap`, keeping the gap where it is. Only the
+    // two halves are written, the new gap is left as it comes from the allocator
+    constexpr void reallocate(size_type new_cap) {
+#ifdef GAPBUFFER_STATS
+        gapbuffer_detail::StatsTimer timer(statsData, GapbufferStats::Op::reallocate);
+        statsData.reallocations++;
+#endif
+#ifdef GAPBUFFER_HAS_MREMAP
+        if constexpr (map_threshold != 0) {
+            if (new_cap * sizeof(CharT) >= map_threshold) {
+                reallocate_mapped(new_cap);
+                return;
+            }
+        }
+#endif
+        if (is_inline() && new_cap <= inline_capacity) {
+            // Still fits, only the right half has to move
+            const size_type rhs_size = bufferEnd - gapEnd;
+#ifdef GAPBUFFER_STATS
+            statsData.bytes_reallocated += rhs_size * sizeof(CharT);
+#endif
+            pointer new_end = inlineStorage + new_cap;
+            if (new_end > bufferEnd) {
+                std::uninitialized_value_construct(bufferEnd, new_end);
+                std::move_backward(gapEnd, bufferEnd, new_end);
+            } else {
+                std::move(gapEnd, bufferEnd, new_end - rhs_size);
+                std::destroy(new_end, bufferEnd);
+            }
+            bufferEnd = new_end;
+            gapEnd = bufferEnd - rhs_size;
+            return;
+        }
+
+#ifdef GAPBUFFER_STATS
+        statsData.bytes_reallocated += size() * sizeof(CharT);
+#endif
+        pointer new_mem = acquire_storage(new_cap);
+        pointer new_end = new_mem + new_cap;
+        std::size_t rhs_size = bufferEnd - gapEnd;
+
+        pointer lhs_buf;
+        if (sharedStorage) [[unlikely]] {
+            // Snapshots may still read the old values, so they are left intact
+            lhs_buf = std::copy(bufferStart, gapStart, new_mem);
+            std::copy(gapEnd, bufferEnd, new_end - rhs_size);
+        } else {
+            lhs_buf = std::move(bufferStart, gapStart, new_mem);
+            std::move(gapEnd, bufferEnd, new_end - rhs_size);
+        }
+
+        release();
+        bufferStart = new_mem;
+        bufferEnd = new_end;
+        gapStart = lhs_buf;
+        gapEnd = bufferEnd - rhs_size;
+    }
+
+#ifdef GAPBUFFER_HAS_MREMAP
+    // Threshold from the growth policy, for the types that may be moved around as plain bytes
+    static constexpr size_type map_threshold = [] {
+        if constexpr (std::is_trivially_copyable_v<CharT> && requires { Growth::map_threshold; }) {
+            return static_cast<size_type>(Growth::map_threshold);
+        } else {
+            return size_type(0);
+        }
+    }();
+
+    static constexpr std::size_t huge_page = 2 << 20;
+
+    // Map `bytes` of zeroed memory starting on a huge page boundary, so the kernel can back all
+    // of it with huge pages. A huge page more is mapped and the ends are trimmed off again
+    static pointer map_huge_pages(std::size_t bytes) {
+        const std::size_t length = bytes + huge_page;
+        void* mem = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                           -1, 0);
+        if (mem == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "Cannot map storage");
+        }
+
+        auto* first = static_cast<std::byte*>(mem);
+        const std::size_t skip =
+            (huge_page - reinterpret_cast<std::uintptr_t>(first) % huge_page) % huge_page;
+        if (skip != 0) {
+            ::munmap(first, skip);
+        }
+        ::munmap(first + skip + bytes, length - skip - bytes);
+#ifdef MADV_HUGEPAGE
+        ::madvise(first + skip, bytes, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<pointer>(first + skip);
+    }
+
+    // reallocate() for storage past the map threshold. A mapping of our own that grows is
+    // remapped, which moves page table entries rather than values, so the left half stays put and
+    // only the right half is moved to the new end. Anything else is copied into a new mapping
+    void reallocate_mapped(size_type new_cap) {
+        const std::size_t bytes = (new_cap * sizeof(CharT) + huge_page - 1) / huge_page * huge_page;
+        const size_type cap = bytes / sizeof(CharT);
+        const size_type lhs_size = gapStart - bufferStart;
+        const size_type rhs_size = bufferEnd - gapEnd;
+
+        if (is_page_mapped() && bytes >= mappedLength) {
+            const size_type old_cap = capacity();
+            void* mem = ::mremap(bufferStart, mappedLength, bytes, MREMAP_MAYMOVE);
+            if (mem == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "Cannot grow storage");
+            }
+#ifdef GAPBUFFER_STATS
+            statsData.bytes_reallocated += rhs_size * sizeof(CharT);
+#endif
+
+            bufferStart = static_cast<pointer>(mem);
+            bufferEnd = bufferStart + cap;
+            gapStart = bufferStart + lhs_size;
+            gapEnd = std::move_backward(bufferStart + old_cap - rhs_size, bufferStart + old_cap,
+                                        bufferEnd);
+            mappedLength = bytes;
+            return;
+        }
+
+#ifdef GAPBUFFER_STATS
+        statsData.bytes_reallocated += size() * sizeof(CharT);
+#endif
+        pointer mem = map_huge_pages(bytes);
+        std::copy(bufferStart, gapStart, mem);
+        std::copy(gapEnd, bufferEnd, mem + cap - rhs_size);
+
+        release();
+        bufferStart = mem;
+        bufferEnd = mem + cap;
+        gapStart = mem + lhs_size;
+        gapEnd = bufferEnd - rhs_size;
+        mappedLength = bytes;
+        mappedAnonymous = true;
+    }
+#endif
+
+    // Give the current storage back to the allocator, or unmap it
+    constexpr void release() noexcept {
+        mappedAnonymous = false;
+        if (sharedStorage) {
+            // Whoever lets go of the storage last frees it
+            sharedStorage.reset();
+            frozenStart = frozenEnd = nullptr;
+            return;
+        }
+#ifdef GAPBUFFER_HAS_MMAP
+        if (mappedLength != 0) {
+            ::munmap(bufferStart, mappedLength);
+            mappedLength = 0;
+            return;
+        }
+#endif
+        if (bufferStart) {
+            std::destroy(bufferStart, bufferEnd);
+            if (!is_inline()) {
+                alloc_traits::deallocate(alloc, bufferStart, capacity());
+            }
+        }
+    }
+
+    [[no_unique_address]] allocator_type alloc;
     pointer bufferStart;
     pointer gapStart;   // One space past the last value in the left half
     pointer gapEnd;     // Pointing to the first value in the right half
     pointer bufferEnd;  // One space past the last value in the right half
+
+    size_type mappedLength = 0;    // Non-zero while the storage is a mapping, of a file unless
+    bool mappedAnonymous = false;  // it was made by reallocate_mapped()
+    std::unique_ptr<LineIndex> lineIndex;
+    std::unique_ptr<CodepointIndex> codepointIndex;
+    std::unique_ptr<Journal> journal;
+    std::shared_ptr<void> sharedStorage;  // Owns the storage while it is shared with snapshots
+    pointer frozenStart = nullptr;        // While shared, only [frozenStart, frozenEnd) may be
+    pointer frozenEnd = nullptr;          // written to
+
+#ifdef GAPBUFFER_STATS
+    GapbufferStats statsData;  // Describes this object only, never copied or moved along
+#endif
+
+    // Storage for small buffers. Values only exist in it while bufferStart points here
+    union {
+        CharT inlineStorage[inline_capacity];
+    };
 };
 
+using Gapbuffer = BasicGapbuffer<char>;
+
+// Variant for std::pmr memory resources, such as a per-session std::pmr::monotonic_buffer_resource
+// whose buffers are all released together
+using PmrGapbuffer = BasicGapbuffer<char, std::pmr::polymorphic_allocator<char>>;
+
 namespace std {
     template <>
     inline std::size_t size(const Gapbuffer& buf) noexcept {
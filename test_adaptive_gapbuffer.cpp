@@ -0,0 +1,152 @@
+#include "adaptive_gapbuffer.h"
+
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+// A document with the gap near the start and a tail far enough away to be deferred
+static Gapbuffer two_spot_document() {
+    auto buf = Gapbuffer(std::string(100 * 1024, '.'));
+    buf.move_gap_to(10);
+    return buf;
+}
+
+TEST_CASE("Adaptive Edits", "[Adaptive]") {
+    auto adaptive = AdaptiveGapbuffer(two_spot_document());
+    std::string model(100 * 1024, '.');
+
+    SECTION("Edits near the gap are made at once") {
+        adaptive.insert(10, "abc");
+        adaptive.erase(11, 1);
+        adaptive.edit(3000, 2, "xyz");
+        model.insert(10, "abc");
+        model.erase(11, 1);
+        model.replace(3000, 2, "xyz");
+        REQUIRE(adaptive.pending() == 0);
+        REQUIRE(adaptive.size() == model.size());
+        REQUIRE(adaptive.buffer().to_str() == model);
+    }
+
+    SECTION("A far edit moves the gap while no spot is hot") {
+        adaptive.insert(50000, "far");
+        model.insert(50000, "far");
+        REQUIRE(adaptive.pending() == 0);
+        REQUIRE(adaptive.buffer().pos() == 50003);
+        REQUIRE(adaptive.buffer().to_str() == model);
+    }
+
+    SECTION("Switching between hot spots defers the far edits") {
+        for (int i = 0; i < 10; i++) {
+            adaptive.insert(10 + i, "a");
+            model.insert(10 + i, "a");
+            adaptive.insert(adaptive.size(), "log\n");
+            model.insert(model.size(), "log\n");
+        }
+        REQUIRE(adaptive.pending() == 1);  // The tail appends were merged into one
+        REQUIRE(adaptive.size() == model.size());
+
+        // Reading applies them, and the gap stays at the insertion point
+        REQUIRE(adaptive.buffer().to_str() == model);
+        REQUIRE(adaptive.pending() == 0);
+        REQUIRE(adaptive.buffer().pos() == 20);
+    }
+
+    SECTION("Too many deferred edits are applied in one sweep") {
+        auto tuned = AdaptiveGapbuffer(two_spot_document(), GapbufferAdaptive{.max_pending = 4});
+        tuned.insert(10, "a");
+        tuned.insert(11, "b");
+        model.insert(10, "ab");
+        for (std::size_t i = 0; i < 5; i++) {
+            const std::size_t pos = 90000 - i * 10000;
+            tuned.erase(pos, 3);
+            model.erase(pos, 3);
+            REQUIRE(tuned.pending() == (i < 4 ? i + 1 : 0));
+        }
+        REQUIRE(tuned.buffer().to_str() == model);
+        REQUIRE(tuned.buffer().pos() == 12);
+    }
+
+    SECTION("Large far edits move the gap") {
+        adaptive.insert(10, "a");
+        adaptive.insert(11, "b");
+        adaptive.insert(80000, "c");
+        const std::string big(1000, 'B');
+        adaptive.insert(60000, big);
+        model.insert(10, "ab");
+        model.insert(80000, "c");
+        model.insert(60000, big);
+        REQUIRE(adaptive.pending() == 0);
+        REQUIRE(adaptive.buffer().pos() == 61000);
+        REQUIRE(adaptive.buffer().to_str() == model);
+    }
+
+    SECTION("Edits touching deferred ones apply those first") {
+        adaptive.insert(10, "a");
+        adaptive.insert(11, "b");
+        adaptive.insert(80000, "tail");
+        REQUIRE(adaptive.pending() == 1);
+        adaptive.erase(80002, 4);
+        model.insert(10, "ab");
+        model.insert(80000, "tail");
+        model.erase(80002, 4);
+        REQUIRE(adaptive.buffer().to_str() == model);
+    }
+
+    SECTION("Edits past the end throw") {
+        REQUIRE_THROWS_AS(adaptive.insert(model.size() + 1, "x"), std::out_of_range);
+        REQUIRE_THROWS_AS(adaptive.erase(model.size() - 1, 2), std::out_of_range);
+        REQUIRE(adaptive.buffer().to_str() == model);
+    }
+}
+
+TEST_CASE("Adaptive Random Edits", "[Adaptive]") {
+    auto adaptive = AdaptiveGapbuffer(two_spot_document());
+    std::string model(100 * 1024, '.');
+    std::mt19937 rng(30);
+
+    // Mostly around three spots that drift with the edits, now and then anywhere
+    std::size_t spots[3] = {10, 40000, 90000};
+    for (int i = 0; i < 3000; i++) {
+        std::size_t& spot = spots[rng() % 3];
+        std::size_t pos = rng() % 8 == 0 ? rng() % (model.size() + 1) : spot;
+        pos = std::min(pos, model.size());
+        if (rng() % 3 != 0 || pos == 0) {
+            const std::string value(1 + rng() % (rng() % 10 == 0 ? 500 : 8),
+                                    static_cast<char>('a' + rng() % 26));
+            adaptive.insert(pos, value);
+            model.insert(pos, value);
+            spot = pos + value.size();
+        } else {
+            const std::size_t count = 1 + rng() % std::min<std::size_t>(pos, 20);
+            adaptive.erase(pos - count, count);
+            model.erase(pos - count, count);
+            spot = pos - count;
+        }
+        REQUIRE(adaptive.size() == model.size());
+        if (i % 500 == 0) {
+            REQUIRE(adaptive.buffer().to_str() == model);
+        }
+    }
+    REQUIRE(adaptive.buffer().to_str() == model);
+}
+
+#ifdef GAPBUFFER_STATS
+TEST_CASE("Adaptive Gap Movement", "[Adaptive]") {
+    // Typing with a log line appended after every few keystrokes
+    auto direct = two_spot_document();
+    auto adaptive = AdaptiveGapbuffer(two_spot_document());
+    for (int i = 0; i < 200; i++) {
+        direct.insert(10 + i, "a");
+        adaptive.insert(10 + i, "a");
+        if (i % 4 == 0) {
+            direct.insert(direct.size(), "log\n");
+            adaptive.insert(adaptive.size(), "log\n");
+        }
+    }
+    REQUIRE(adaptive.buffer().to_str() == direct.to_str());
+    REQUIRE(adaptive.buffer().stats().bytes_moved * 10 < direct.stats().bytes_moved);
+}
+#endif
@@ -0,0 +1,342 @@
+#include "chunked_gapbuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+// Leaves this small make every test cross many leaf boundaries
+using SmallChunked = BasicChunkedGapbuffer<char, std::allocator<char>, 16>;
+
+static std::string numbered_lines(int count) {
+    std::string ret;
+    for (int i = 0; i < count; i++) {
+        ret += "line " + std::to_string(i) + "\n";
+    }
+    return ret;
+}
+
+TEST_CASE("Chunked Constructors", "[Chunked]") {
+    SECTION("Default") {
+        auto buf = SmallChunked();
+        REQUIRE(buf.empty());
+        REQUIRE(buf.leaf_count() == 1);
+        REQUIRE(buf.to_str() == "");
+        REQUIRE(buf.begin() == buf.end());
+    }
+
+    SECTION("String") {
+        const std::string s = numbered_lines(20);
+        auto buf = SmallChunked(s);
+        REQUIRE(buf.size() == s.size());
+        REQUIRE(buf.to_str() == s);
+        REQUIRE(buf.leaf_count() > s.size() / SmallChunked::chunk_size);
+    }
+
+    SECTION("Initializer list") {
+        auto buf = SmallChunked({'a', 'b', 'c'});
+        REQUIRE(buf.to_str() == "abc");
+    }
+}
+
+TEST_CASE("Chunked Element Access", "[Chunked]") {
+    const std::string s = numbered_lines(10);
+    auto buf = SmallChunked(s);
+
+    for (std::size_t i = 0; i < s.size(); i++) {
+        REQUIRE(buf[i] == s[i]);
+    }
+    REQUIRE(buf.back() == '\n');
+    REQUIRE_THROWS_AS(buf.at(s.size()), std::out_of_range);
+
+    buf.at(0) = 'L';
+    REQUIRE(buf.to_str().front() == 'L');
+}
+
+TEST_CASE("Chunked Data At", "[Chunked]") {
+    const std::string s = numbered_lines(10);
+    auto buf = SmallChunked(s);
+    buf.move_gap_to(21);
+
+    // Joining the runs from the start gives back the contents
+    std::string joined;
+    for (std::size_t pos = 0; pos < buf.size();) {
+        const auto run = std::as_const(buf).data_at(pos);
+        REQUIRE_FALSE(run.empty());
+        REQUIRE(run.size() <= SmallChunked::chunk_size);
+        joined.append(run.data(), run.size());
+        pos += run.size();
+    }
+    REQUIRE(joined == s);
+
+    REQUIRE(buf.data_at(buf.size()).empty());
+    REQUIRE_THROWS_AS(buf.data_at(buf.size() + 1), std::out_of_range);
+}
+
+TEST_CASE("Chunked Iterators", "[Chunked]") {
+    const std::string s = numbered_lines(10);
+    auto buf = SmallChunked(s);
+
+    REQUIRE(std::string(buf.begin(), buf.end()) == s);
+    REQUIRE(std::string(buf.cbegin(), buf.cend()) == s);
+
+    std::string reversed;
+    for (auto it = buf.end(); it != buf.begin();) {
+        reversed += *--it;
+    }
+    REQUIRE(std::string(reversed.rbegin(), reversed.rend()) == s);
+
+    std::replace(buf.begin(), buf.end(), 'l', 'L');
+    REQUIRE(buf.to_str().find('l') == std::string::npos);
+}
+
+TEST_CASE("Chunked Random Access Iterators", "[Chunked]") {
+    const std::string s = numbered_lines(20);
+    auto buf = SmallChunked(s);
+    REQUIRE(buf.leaf_count() > 10);
+    const auto n = static_cast<std::ptrdiff_t>(s.size());
+
+    SECTION("Jumps match indexing") {
+        for (std::ptrdiff_t i = 0; i < n; i += 7) {
+            auto it = buf.begin() + i;
+            REQUIRE(*it == s[i]);
+            REQUIRE(buf.begin()[i] == s[i]);
+            REQUIRE(it - buf.begin() == i);
+            REQUIRE(buf.end() - it == n - i);
+            REQUIRE(*(buf.end() - (n - i)) == s[i]);
+            REQUIRE((it + (n - i)) == buf.end());
+        }
+        REQUIRE(buf.begin() + n == buf.end());
+        REQUIRE(buf.end() - n == buf.begin());
+    }
+
+    SECTION("Steps across leaves") {
+        auto it = buf.begin();
+        for (std::ptrdiff_t i = 0; i + 5 < n; i += 5) {
+            REQUIRE(buf.begin() + i == it);
+            it += 5;
+            REQUIRE(*it == s[i + 5]);
+            it -= 3;
+            REQUIRE(*it == s[i + 2]);
+            it += 3;
+        }
+    }
+
+    SECTION("Ordering") {
+        REQUIRE(buf.begin() < buf.begin() + 20);
+        REQUIRE(buf.begin() + 20 < buf.end());
+        REQUIRE(buf.end() - 1 >= buf.begin() + (n - 1));
+    }
+
+    SECTION("Algorithms") {
+        std::string sorted = s;
+        std::sort(sorted.begin(), sorted.end());
+        std::sort(buf.begin(), buf.end());
+        REQUIRE(buf.to_str() == sorted);
+        REQUIRE(std::binary_search(buf.cbegin(), buf.cend(), '9'));
+        REQUIRE(std::lower_bound(buf.begin(), buf.end(), 'l') - buf.begin() ==
+                std::lower_bound(sorted.begin(), sorted.end(), 'l') - sorted.begin());
+    }
+}
+
+TEST_CASE("Chunked Insert and Erase", "[Chunked]") {
+    auto buf = SmallChunked();
+    std::string model;
+
+    SECTION("Typing") {
+        for (char c : numbered_lines(10)) {
+            buf.push_back(c);
+            model.push_back(c);
+        }
+        REQUIRE(buf.to_str() == model);
+        REQUIRE(buf.pos() == model.size());
+
+        for (int i = 0; i < 20; i++) {
+            REQUIRE(buf.pop_back() == model.back());
+            model.pop_back();
+        }
+        REQUIRE(buf.to_str() == model);
+    }
+
+    SECTION("Large insert is split across leaves") {
+        const std::string big(1000, 'x');
+        buf.insert(big);
+        REQUIRE(buf.to_str() == big);
+        REQUIRE(buf.leaf_count() >= big.size() / SmallChunked::chunk_size);
+
+        buf.move_gap_to(1000);
+        buf.erase(1000);
+        REQUIRE(buf.empty());
+        REQUIRE(buf.leaf_count() == 1);
+    }
+
+    SECTION("Random edits match std::string") {
+        std::mt19937 rng(7);
+        for (int i = 0; i < 2000; i++) {
+            const std::size_t pos = model.empty() ? 0 : rng() % (model.size() + 1);
+            if (rng() % 3 != 0 || pos == 0) {
+                const std::string value(1 + rng() % 40, static_cast<char>('a' + rng() % 26));
+                buf.insert(pos, value);
+                model.insert(pos, value);
+                REQUIRE(buf.pos() == pos + value.size());
+            } else {
+                const std::size_t count = 1 + rng() % pos;
+                buf.move_gap_to(pos);
+                buf.erase(count);
+                model.erase(pos - count, count);
+                REQUIRE(buf.pos() == pos - count);
+            }
+            REQUIRE(buf.size() == model.size());
+        }
+        REQUIRE(buf.to_str() == model);
+
+        // Erasing keeps the leaves from fragmenting
+        REQUIRE(buf.leaf_count() <= model.size() / (SmallChunked::chunk_size / 4) + 2);
+    }
+
+    SECTION("Erase past the cursor throws") {
+        buf.insert("abc");
+        buf.move_gap_to(1);
+        REQUIRE_THROWS_AS(buf.erase(2), std::out_of_range);
+        REQUIRE_THROWS_AS(buf.move_gap_to(4), std::out_of_range);
+    }
+
+    SECTION("Clear") {
+        buf.insert(numbered_lines(10));
+        buf.clear();
+        REQUIRE(buf.empty());
+        REQUIRE(buf.pos() == 0);
+        REQUIRE(buf.line_count() == 0);
+    }
+}
+
+TEST_CASE("Chunked append_chunk", "[Chunked]") {
+    const std::string s = numbered_lines(30);
+    auto buf = SmallChunked("x");
+    buf.move_gap_to(1);
+
+    for (std::size_t i = 0; i < s.size(); i += 7) {
+        const std::string chunk = s.substr(i, 7);
+        buf.append_chunk(std::span<const char>(chunk.data(), chunk.size()));
+    }
+    REQUIRE(buf.to_str() == "x" + s);
+    REQUIRE(buf.pos() == 1);
+    REQUIRE(buf.line_count() == 30);
+}
+
+TEST_CASE("Chunked Cursor", "[Chunked]") {
+    auto buf = SmallChunked("hello world");
+    REQUIRE(buf.pos() == 0);
+
+    buf.retreat();
+    REQUIRE(buf.pos() == 0);
+
+    buf.move_gap_to(11);
+    buf.advance();
+    REQUIRE(buf.pos() == 11);
+
+    buf.move_gap(-6);
+    buf.insert(",");
+    REQUIRE(buf.to_str() == "hello, world");
+    REQUIRE_THROWS_AS(buf.move_gap(-7), std::out_of_range);
+}
+
+TEST_CASE("Chunked Lines", "[Chunked]") {
+    const std::string s = numbered_lines(50);
+    auto buf = SmallChunked(s);
+    const auto reference = Gapbuffer(s);
+
+    REQUIRE(buf.line_count() == reference.line_count());
+    for (std::size_t pos = 0; pos < s.size(); pos += 3) {
+        REQUIRE(buf.line_of(pos) == reference.line_of(pos));
+        REQUIRE(buf.line(pos) == reference.line(pos));
+    }
+    for (std::size_t line = 0; line < 50; line++) {
+        REQUIRE(buf.line_start(line) == reference.line_start(line));
+    }
+    REQUIRE_THROWS_AS(buf.line_start(51), std::out_of_range);
+
+    SECTION("Counts follow edits") {
+        buf.insert(0, "new\nlines\n");
+        buf.move_gap_to(buf.size());
+        buf.erase(8);
+        const auto edited = Gapbuffer(buf.to_str());
+        REQUIRE(buf.line_count() == edited.line_count());
+        REQUIRE(buf.count('\n') == edited.count('\n'));
+        REQUIRE(buf.line(buf.size() - 1) == edited.line(edited.size() - 1));
+    }
+
+    SECTION("Empty buffer") {
+        auto empty = SmallChunked();
+        REQUIRE(empty.line_count() == 0);
+        REQUIRE_THROWS_AS(empty.line(0), std::runtime_error);
+    }
+}
+
+TEST_CASE("Chunked Find", "[Chunked]") {
+    const std::string s = numbered_lines(40);
+    auto buf = SmallChunked(s);
+
+    SECTION("Characters") {
+        REQUIRE(buf.find('\n') == static_cast<int>(s.find('\n')));
+        REQUIRE(buf.find('7', 2) == static_cast<int>(s.find('7', s.find('7') + 1)));
+        REQUIRE(buf.find('z') == -1);
+        REQUIRE(buf.count('1') == static_cast<std::size_t>(std::count(s.begin(), s.end(), '1')));
+    }
+
+    SECTION("Substrings across leaf boundaries") {
+        for (std::size_t len : {1, 2, 5, 15, 16, 17, 40}) {
+            for (std::size_t start = 0; start + len <= s.size(); start += 7) {
+                const std::string needle = s.substr(start, len);
+                REQUIRE(buf.find(needle) == s.find(needle));
+                REQUIRE(buf.find(needle, start) == s.find(needle, start));
+                REQUIRE(buf.find(needle, start + 1) == s.find(needle, start + 1));
+            }
+        }
+        REQUIRE(buf.find("not there") == SmallChunked::npos);
+        REQUIRE(buf.find("", 3) == 3);
+    }
+}
+
+TEST_CASE("Chunked for_each_segment", "[Chunked]") {
+    const std::string s = numbered_lines(10);
+    auto buf = SmallChunked(s);
+
+    std::string joined;
+    std::size_t calls = 0;
+    REQUIRE(buf.for_each_segment([&](std::span<const char> seg) {
+        joined.append(seg.data(), seg.size());
+        calls++;
+    }));
+    REQUIRE(joined == s);
+    REQUIRE(calls >= buf.leaf_count());
+
+    calls = 0;
+    REQUIRE_FALSE(buf.for_each_segment([&](std::span<const char>) {
+        calls++;
+        return false;
+    }));
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("Chunked Snapshot", "[Chunked]") {
+    const std::string s = numbered_lines(40);
+    auto buf = SmallChunked(s);
+    const auto snap = buf.snapshot();
+
+    buf.insert(0, ">>");
+    buf.move_gap_to(200);
+    buf.erase(30);
+    buf.insert(std::string(100, 'z'));
+
+    std::string expected = ">>" + s;
+    expected.erase(170, 30);
+    expected.insert(170, std::string(100, 'z'));
+    REQUIRE(buf.to_str() == expected);
+    REQUIRE(snap.to_str() == s);
+    REQUIRE(snap.line_count() == 40);
+}
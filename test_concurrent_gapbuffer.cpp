@@ -0,0 +1,217 @@
+#include "concurrent_gapbuffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Concurrent Reads", "[Concurrent]") {
+    auto doc = ConcurrentGapbuffer(Gapbuffer("hello world\nsecond line\n"));
+    REQUIRE(doc.version() == 1);
+    REQUIRE(doc.size() == 24);
+    REQUIRE(doc[4] == 'o');
+    REQUIRE(doc.at(12) == 's');
+    REQUIRE_THROWS_AS(doc.at(24), std::out_of_range);
+    REQUIRE(doc.line(14) == "second line\n");
+
+    // A version is unaffected by later edits and stays valid while it is held
+    const auto before = doc.current();
+    doc.insert(5, ",");
+    doc.erase(0, 1);
+    doc.insert(0, "H");
+    REQUIRE(doc.to_str() == "Hello, world\nsecond line\n");
+    REQUIRE(doc.version() > before->number);
+    REQUIRE(before->contents.to_str() == "hello world\nsecond line\n");
+    const auto [left, right] = before->contents.segments();
+    REQUIRE(left.size() + right.size() == 24);
+
+    std::string joined;
+    REQUIRE(doc.for_each_segment([&](std::span<const char> seg) {
+        joined.append(seg.data(), seg.size());
+    }));
+    REQUIRE(joined == "Hello, world\nsecond line\n");
+}
+
+TEST_CASE("Concurrent Versions", "[Concurrent]") {
+    std::string model(1 << 20, '.');
+    auto doc = ConcurrentGapbuffer(Gapbuffer(model));
+
+    SECTION("Edits never leave the writer's storage shared") {
+        for (std::size_t i = 0; i < 10; i++) {
+            doc.insert(i * 100000, "x");
+            model.insert(i * 100000, "x");
+            REQUIRE(doc.size() == model.size());
+            REQUIRE_FALSE(doc.write([](Gapbuffer& buf) { return buf.is_shared(); }));
+        }
+        REQUIRE(doc.to_str() == model);
+    }
+
+    SECTION("Versions nobody holds are caught up and published again") {
+        doc.insert(0, "a");
+        const auto* second = doc.current().get();
+        doc.insert(10, "b");
+        doc.insert(500000, "c");
+        REQUIRE(doc.current().get() == second);
+        REQUIRE(doc.version() == 4);
+
+        model.insert(0, "a");
+        model.insert(10, "b");
+        model.insert(500000, "c");
+        REQUIRE(doc.to_str() == model);
+    }
+
+    SECTION("A held version is copied away from") {
+        const auto held = doc.current();
+        doc.insert(0, "x");
+        doc.insert(500000, "y");
+        doc.insert(20, "z");
+        REQUIRE(held->contents.to_str() == std::string(1 << 20, '.'));
+        REQUIRE(doc.current() != held);
+        model.insert(0, "x");
+        model.insert(500000, "y");
+        model.insert(20, "z");
+        REQUIRE(doc.to_str() == model);
+    }
+}
+
+TEST_CASE("Concurrent Edits", "[Concurrent]") {
+    auto doc = ConcurrentGapbuffer();
+
+    SECTION("Edits apply in the order they were made") {
+        doc.insert(0, "abc");
+        doc.insert(3, "def");
+        doc.insert(0, ">");
+        doc.erase(2, 2);
+        doc.edit(3, 1, "XY");
+        REQUIRE(doc.to_str() == ">adXYf");
+        REQUIRE(doc.version() == 6);
+    }
+
+    SECTION("Edits past the end throw to the thread making them") {
+        doc.insert(0, "abc");
+        REQUIRE_THROWS_AS(doc.insert(4, "x"), std::out_of_range);
+        REQUIRE_THROWS_AS(doc.erase(1, 3), std::out_of_range);
+        REQUIRE(doc.to_str() == "abc");
+        REQUIRE(doc.version() == 2);
+    }
+
+    SECTION("Edits made during write() are checked against what it leaves") {
+        doc.insert(0, "0123456789");
+        std::thread typist;
+        bool rejected = false;
+        doc.write([&](Gapbuffer& buf) {
+            typist = std::thread([&] {
+                try {
+                    doc.insert(8, "bad");
+                } catch (const std::out_of_range&) {
+                    rejected = true;
+                }
+                doc.insert(0, ">");
+            });
+            buf.move_gap_to(buf.size());
+            buf.erase(5);
+        });
+        typist.join();
+
+        REQUIRE(rejected);
+        REQUIRE(doc.to_str() == ">01234");
+        REQUIRE(doc.size() == 6);
+    }
+
+    SECTION("Random edits match std::string") {
+        std::mt19937 rng(29);
+        std::string model;
+        std::atomic<bool> done = false;
+        std::thread reader([&] {
+            while (!done.load()) {
+                const auto version = doc.current();
+                if (!version->contents.empty()) {
+                    (void)version->contents.at(version->contents.size() - 1);
+                }
+            }
+        });
+        for (int i = 0; i < 500; i++) {
+            const std::size_t pos = model.empty() ? 0 : rng() % (model.size() + 1);
+            if (rng() % 3 != 0 || pos == model.size()) {
+                const std::string value(1 + rng() % 5, static_cast<char>('a' + rng() % 26));
+                doc.insert(pos, value);
+                model.insert(pos, value);
+            } else {
+                const std::size_t count = 1 + rng() % (model.size() - pos);
+                doc.erase(pos, count);
+                model.erase(pos, count);
+            }
+        }
+        done = true;
+        reader.join();
+        doc.flush();
+        REQUIRE(doc.to_str() == model);
+    }
+
+    SECTION("Writing through write()") {
+        doc.insert(0, "one\ntwo\n");
+        const auto lines = doc.write([](Gapbuffer& buf) {
+            buf.enable_line_index();
+            return buf.line_count();
+        });
+        REQUIRE(lines == 2);
+        REQUIRE(doc.current()->contents.has_line_index());
+
+        // Later versions are caught up from the one write() published
+        doc.insert(0, "zero\n");
+        doc.insert(0, "");
+        doc.insert(4, "!");
+        REQUIRE(doc.to_str() == "zero!\none\ntwo\n");
+        REQUIRE(doc.current()->contents.line_count() == 3);
+    }
+}
+
+TEST_CASE("Concurrent Readers and Writers", "[Concurrent]") {
+    auto doc = ConcurrentGapbuffer(Gapbuffer(std::string(1000, '.')));
+    std::atomic<bool> done = false;
+    std::atomic<bool> consistent = true;
+
+    // Every edit keeps the size, so any version a reader sees must have the same size and
+    // hold only the values written to it
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; r++) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                const auto version = doc.current();
+                const std::string s = version->contents.to_str();
+                if (s.size() != 1000 || s.find_first_not_of(".abcd") != std::string::npos) {
+                    consistent = false;
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int w = 0; w < 2; w++) {
+        writers.emplace_back([&, w] {
+            std::mt19937 rng(w);
+            for (int i = 0; i < 300; i++) {
+                const std::size_t pos = rng() % 990;
+                doc.edit(pos, 10, std::string(10, static_cast<char>('a' + rng() % 4)));
+            }
+        });
+    }
+    for (auto& t : writers) {
+        t.join();
+    }
+    doc.flush();
+    done = true;
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    REQUIRE(consistent.load());
+    REQUIRE(doc.size() == 1000);
+    REQUIRE(doc.version() > 1);
+}
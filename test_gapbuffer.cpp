@@ -1,7 +1,25 @@
 #include "gapbuffer.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <random>
+#include <span>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -145,15 +163,451 @@ TEST_CASE("Move Assignment Constructor", "[Constructors]") {
     REQUIRE_FALSE(buf_move.to_str() == buf.to_str());
 }
 
+TEST_CASE("Move Steals Storage", "[Constructors]") {
+    STATIC_REQUIRE(std::is_nothrow_move_constructible_v<Gapbuffer>);
+    STATIC_REQUIRE(std::is_nothrow_move_assignable_v<Gapbuffer>);
+    STATIC_REQUIRE(std::is_nothrow_swappable_v<Gapbuffer>);
+
+    const std::string s(100, 'a');
+    auto buf = Gapbuffer(s);
+    const char* storage = &buf.at(0);
+
+    SECTION("Construction") {
+        auto buf_move = std::move(buf);
+        REQUIRE(&buf_move.at(0) == storage);
+        REQUIRE(buf.empty());
+        REQUIRE(buf.capacity() == 0);
+
+        buf.insert("reused");
+        REQUIRE(buf.to_str() == "reused");
+    }
+
+    SECTION("Assignment") {
+        auto buf_move = Gapbuffer(std::string(50, 'b'));
+        buf_move = std::move(buf);
+        REQUIRE(&buf_move.at(0) == storage);
+        REQUIRE(buf_move.to_str() == s);
+        REQUIRE(buf.empty());
+    }
+
+    SECTION("Inline values are moved") {
+        auto small = Gapbuffer("hello");
+        small.move_gap_to(2);
+        auto small_move = std::move(small);
+        REQUIRE(small_move.is_inline());
+        REQUIRE(small_move.pos() == 2);
+        REQUIRE(small_move.to_str() == "hello");
+        REQUIRE(small.empty());
+    }
+
+    SECTION("Vector growth relocates without copying") {
+        std::vector<Gapbuffer> buffers;
+        buffers.push_back(std::move(buf));
+        for (int i = 0; i < 100; i++) {
+            buffers.emplace_back("short");
+        }
+        REQUIRE(&buffers.front().at(0) == storage);
+        REQUIRE(buffers.back().to_str() == "short");
+    }
+}
+
+TEST_CASE("Swap", "[Constructors]") {
+    auto large = Gapbuffer(std::string(100, 'a'));
+    auto small = Gapbuffer("hello");
+    large.move_gap_to(10);
+    small.move_gap_to(3);
+    const char* storage = &large.at(0);
+
+    SECTION("Member") {
+        large.swap(small);
+        REQUIRE(small.to_str() == std::string(100, 'a'));
+        REQUIRE(&small.at(0) == storage);
+        REQUIRE(small.pos() == 10);
+        REQUIRE(large.to_str() == "hello");
+        REQUIRE(large.is_inline());
+        REQUIRE(large.pos() == 3);
+    }
+
+    SECTION("Non-member") {
+        using std::swap;
+        swap(small, large);
+        REQUIRE(small.to_str() == std::string(100, 'a'));
+        REQUIRE(large.to_str() == "hello");
+    }
+
+    SECTION("Both inline") {
+        auto other = Gapbuffer("world");
+        swap(small, other);
+        REQUIRE(small.to_str() == "world");
+        REQUIRE(other.to_str() == "hello");
+        REQUIRE(other.pos() == 3);
+    }
+
+    SECTION("Line index goes along") {
+        large.enable_line_index();
+        swap(large, small);
+        REQUIRE(small.has_line_index());
+        REQUIRE_FALSE(large.has_line_index());
+    }
+
+    SECTION("Self") {
+        swap(small, small);
+        REQUIRE(small.to_str() == "hello");
+    }
+}
+
+// Counts what goes through it, handing the requests on to new and delete
+struct CountingResource : std::pmr::memory_resource {
+    int allocations = 0;
+    int deallocations = 0;
+    std::size_t outstanding = 0;  // Bytes allocated and not yet given back
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        allocations++;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+        deallocations++;
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
 TEST_CASE("Destructor", "[Constructors]") {
-    char* e;
+    CountingResource counter;
+
+    SECTION("Allocated storage is given back") {
+        {
+            // Long enough to be allocated rather than stored inline
+            auto buf = PmrGapbuffer("Hello, this is longer than the inline storage", &counter);
+            REQUIRE_FALSE(buf.is_inline());
+            REQUIRE(counter.allocations == 1);
+            REQUIRE(counter.outstanding == buf.capacity());
+        }  // Out of scope, gets destructed
+
+        REQUIRE(counter.deallocations == counter.allocations);
+        REQUIRE(counter.outstanding == 0);
+    }
+
+    SECTION("Inline storage allocates nothing") {
+        {
+            auto buf = PmrGapbuffer("hello", &counter);
+            buf.insert(" world");
+            REQUIRE(buf.is_inline());
+        }
+
+        REQUIRE(counter.allocations == 0);
+        REQUIRE(counter.deallocations == 0);
+    }
+}
+
+TEST_CASE("Inline Storage", "[Constructors]") {
+    SECTION("Small buffers are stored inline") {
+        REQUIRE(Gapbuffer().is_inline());
+        REQUIRE(Gapbuffer(16).is_inline());
+        REQUIRE(Gapbuffer("hello").is_inline());
+        REQUIRE_FALSE(Gapbuffer(Gapbuffer::inline_capacity + 1).is_inline());
+    }
+
+    SECTION("Grows within the inline storage") {
+        auto buf = Gapbuffer("hello");
+        buf.move_gap_to(2);
+        buf.insert("abcdefghij");
+        REQUIRE(buf.is_inline());
+        REQUIRE(buf.capacity() == 26);
+        REQUIRE(buf.to_str() == "heabcdefghijllo");
+    }
+
+    SECTION("Spills to allocated storage") {
+        auto buf = Gapbuffer("hello world");
+        buf.move_gap_to(5);
+        buf.insert(std::string(40, 'x'));
+        REQUIRE_FALSE(buf.is_inline());
+        REQUIRE(buf.to_str() == "hello" + std::string(40, 'x') + " world");
+
+        SECTION("And comes back after shrinking") {
+            buf.erase(40);
+            buf.shrink_to_fit();
+            REQUIRE(buf.is_inline());
+            REQUIRE(buf.pos() == 5);
+            REQUIRE(buf.to_str() == "hello world");
+        }
+    }
+
+    SECTION("Copies and moves") {
+        auto buf = Gapbuffer("hello");
+        buf.move_gap_to(1);
+
+        auto copy = buf;
+        REQUIRE(copy.is_inline());
+        REQUIRE(copy == buf);
 
+        copy.insert("X");
+        REQUIRE(copy.to_str() == "hXello");
+        REQUIRE(buf.to_str() == "hello");
+
+        auto moved = Gapbuffer(std::string(64, 'y'));
+        moved = std::move(copy);
+        REQUIRE(moved.is_inline());
+        REQUIRE(moved.to_str() == "hXello");
+        REQUIRE(copy.empty());
+    }
+}
+
+TEST_CASE("From File", "[Constructors]") {
+    const auto path = std::filesystem::temp_directory_path() / "gapbuffer_from_file.txt";
     {
-        auto buf = Gapbuffer("Hello");
-        e = &buf.at(1);
-    }  // Out of scope, gets destructed
+        std::ofstream file(path, std::ios::binary);
+        file << "hello world\nlorem ipsum";
+    }
+
+    SECTION("Reads through the mapping") {
+        auto buf = Gapbuffer::from_file(path);
+        REQUIRE(buf.is_mapped());
+        REQUIRE(buf.size() == 23);
+        REQUIRE(buf.gap_size() == 0);
+        REQUIRE(buf.line(3) == "hello world\n");
+        REQUIRE(buf.to_str() == "hello world\nlorem ipsum");
+    }
+
+    SECTION("First edit copies out of the mapping") {
+        auto buf = Gapbuffer::from_file(path);
+        buf.push_back('!');
+        REQUIRE_FALSE(buf.is_mapped());
+        REQUIRE(buf.to_str() == "hello world\nlorem ipsum!");
+
+        buf.move_gap_to(5);
+        buf.insert(",");
+        REQUIRE(buf.to_str() == "hello, world\nlorem ipsum!");
+    }
+
+    SECTION("Edits do not reach the file") {
+        {
+            auto buf = Gapbuffer::from_file(path);
+            buf[0] = 'j';
+            buf.move_gap_to(4);
+            buf.erase(2);
+            REQUIRE(buf.to_str() == "jeo world\nlorem ipsum");
+        }
+        REQUIRE(Gapbuffer::from_file(path).to_str() == "hello world\nlorem ipsum");
+    }
 
-    REQUIRE_FALSE(*e == 'e');
+    SECTION("Moving keeps the mapping") {
+        auto buf = Gapbuffer::from_file(path);
+        auto buf_move = std::move(buf);
+        REQUIRE(buf_move.is_mapped());
+        REQUIRE_FALSE(buf.is_mapped());
+        REQUIRE(buf_move.to_str() == "hello world\nlorem ipsum");
+    }
+
+    SECTION("Missing file") {
+        REQUIRE_THROWS_AS(Gapbuffer::from_file(path.string() + ".missing"), std::system_error);
+    }
+
+    std::filesystem::remove(path);
+}
+
+// Counts its live instances, and throws from copies once `copies_left` runs out
+struct Tracked {
+    static inline int live = 0;
+    static inline int copies_left = -1;
+
+    static void copied() {
+        if (copies_left == 0) {
+            throw std::runtime_error("copy failed");
+        }
+        copies_left--;
+    }
+
+    int value = 0;
+
+    Tracked() { live++; }
+    Tracked(int v) : value(v) { live++; }
+    Tracked(const Tracked& other) : value(other.value) {
+        copied();
+        live++;
+    }
+    Tracked(Tracked&& other) noexcept : value(std::exchange(other.value, -1)) { live++; }
+    Tracked& operator=(const Tracked& other) {
+        copied();
+        value = other.value;
+        return *this;
+    }
+    Tracked& operator=(Tracked&& other) noexcept {
+        value = std::exchange(other.value, -1);
+        return *this;
+    }
+    ~Tracked() { live--; }
+
+    bool operator==(const Tracked& other) const { return value == other.value; }
+};
+
+// Per-character attributes as a layout engine would keep them next to the text
+struct Attribute {
+    std::uint32_t color;
+    std::uint16_t font;
+    bool operator==(const Attribute&) const = default;
+};
+
+TEST_CASE("Value Types", "[Constructors]") {
+    SECTION("UTF-32") {
+        auto buf = BasicGapbuffer<char32_t>(U"héllo\nw\U0001F600rld");
+        buf.move_gap_to(6);
+        buf.insert(U"€");
+        REQUIRE(buf.to_str() == U"héllo\n€w\U0001F600rld");
+        REQUIRE(buf.line_count() == 2);
+        REQUIRE(buf.find(U"w\U0001F600") == 7);
+        REQUIRE(buf.count(U'l') == 3);
+    }
+
+    SECTION("Trivially copyable records") {
+        using Attributes = BasicGapbuffer<Attribute>;
+        static_assert(std::is_same_v<Attributes::string_view_type, std::span<const Attribute>>);
+
+        const std::vector<Attribute> run(100, Attribute{0xff0000, 1});
+        auto buf = Attributes();
+        buf.insert(run);
+        buf.move_gap_to(40);
+        buf.push_back(Attribute{0x00ff00, 2});
+
+        REQUIRE(buf.size() == 101);
+        REQUIRE(buf[40] == Attribute{0x00ff00, 2});
+        REQUIRE(buf.count(Attribute{0xff0000, 1}) == 100);
+
+        const auto erased = buf.erase(5);
+        REQUIRE(erased.size() == 5);
+        REQUIRE(erased[4] == Attribute{0x00ff00, 2});
+        REQUIRE(buf.count(Attribute{0x00ff00, 2}) == 0);
+
+        const std::array<Attribute, 2> bold = {Attribute{0, 7}, Attribute{0, 7}};
+        const std::array<Attributes::Edit, 2> edits = {
+            Attributes::Edit{0, 1, bold},
+            Attributes::Edit{50, 0, bold},
+        };
+        buf.apply_batch(edits, 0);
+        REQUIRE(buf.size() == 99);
+        REQUIRE(buf.count(Attribute{0, 7}) == 4);
+
+        const auto copy = buf;
+        REQUIRE(copy == buf);
+        REQUIRE(std::equal(copy.begin(), copy.end(), buf.begin(), buf.end()));
+    }
+
+    SECTION("Values with constructors and destructors") {
+        {
+            auto buf = BasicGapbuffer<Tracked>();
+            // Every slot of the storage holds a live value, in the gap too
+            REQUIRE(Tracked::live == static_cast<int>(buf.capacity()));
+
+            for (int i = 0; i < 200; i++) {
+                buf.push_back(Tracked(i));
+            }
+            REQUIRE(Tracked::live == static_cast<int>(buf.capacity()));
+
+            buf.move_gap_to(100);
+            REQUIRE(buf.pop_back().value == 99);
+            buf.erase(9);
+            REQUIRE(buf.size() == 190);
+            REQUIRE(buf[90].value == 100);
+
+            buf.enable_undo();
+            buf.push_back(Tracked(-5));
+            REQUIRE(buf.undo());
+            REQUIRE(buf.size() == 190);
+
+            auto snap = buf.snapshot();
+            buf.move_gap_to(0);
+            REQUIRE(snap[0].value == 0);
+            REQUIRE(snap[189].value == 199);
+
+            buf.clear();
+            REQUIRE(buf.empty());
+            buf.push_back(Tracked(1));
+            REQUIRE(buf[0].value == 1);
+        }
+        REQUIRE(Tracked::live == 0);
+    }
+
+    SECTION("A copy that throws leaves nothing behind") {
+        const std::vector<Tracked> values(50, Tracked(3));
+        const int before = Tracked::live;
+
+        Tracked::copies_left = 20;
+        REQUIRE_THROWS_AS(BasicGapbuffer<Tracked>(values.begin(), values.end()),
+                          std::runtime_error);
+        REQUIRE(Tracked::live == before);
+
+        Tracked::copies_left = -1;
+        auto buf = BasicGapbuffer<Tracked>(values.begin(), values.end());
+        Tracked::copies_left = 10;
+        REQUIRE_THROWS_AS(BasicGapbuffer<Tracked>(buf), std::runtime_error);
+        Tracked::copies_left = -1;
+        REQUIRE(Tracked::live == before + static_cast<int>(buf.capacity()));
+    }
+
+    SECTION("A batch built in one pass is undone by a copy that throws") {
+        const std::vector<Tracked> values(40, Tracked(3));
+        const std::vector<Tracked> more(100, Tracked(4));
+        auto buf = BasicGapbuffer<Tracked>(values.begin(), values.end());
+        const int before = Tracked::live;
+
+        const std::array<BasicGapbuffer<Tracked>::Edit, 1> edits = {{{10, 0, more}}};
+        Tracked::copies_left = 60;
+        REQUIRE_THROWS_AS(buf.apply_batch(edits, 0), std::runtime_error);
+        Tracked::copies_left = -1;
+        REQUIRE(Tracked::live == before);
+        REQUIRE(buf.size() == 40);
+        REQUIRE(std::all_of(buf.begin(), buf.end(), [](const Tracked& t) { return t.value == 3; }));
+    }
+}
+
+TEST_CASE("Get Allocator", "[Allocator]") {
+    std::pmr::monotonic_buffer_resource arena;
+    auto buf = PmrGapbuffer("hello world", &arena);
+
+    REQUIRE(buf.get_allocator().resource() == &arena);
+    REQUIRE(buf.to_str() == "hello world");
+}
+
+TEST_CASE("Memory Resource", "[Allocator]") {
+    std::array<std::byte, 1024> storage;
+    std::pmr::monotonic_buffer_resource arena(
+        storage.data(), storage.size(), std::pmr::null_memory_resource());
+
+    SECTION("All storage comes from the arena") {
+        auto buf = PmrGapbuffer(&arena);
+        buf.insert("hello world");
+        buf.insert(std::string(100, '_'));
+
+        REQUIRE(buf.size() == 111);
+        REQUIRE(buf.capacity() == 128);
+        REQUIRE(std::less_equal<>()(storage.data(), reinterpret_cast<std::byte*>(&buf.at(0))));
+        REQUIRE(std::less<>()(reinterpret_cast<std::byte*>(&buf.at(0)), storage.data() + 1024));
+    }
+
+    SECTION("Copies get the default resource") {
+        auto buf = PmrGapbuffer("hello world", &arena);
+        auto buf_copy(buf);
+
+        REQUIRE(buf_copy.get_allocator().resource() == std::pmr::get_default_resource());
+        REQUIRE(buf_copy.to_str() == "hello world");
+    }
+
+    SECTION("Move assignment across resources copies") {
+        std::pmr::monotonic_buffer_resource other_arena;
+        auto buf = PmrGapbuffer("hello world", &arena);
+        auto buf_other = PmrGapbuffer(&other_arena);
+
+        buf_other = std::move(buf);
+        REQUIRE(buf_other.get_allocator().resource() == &other_arena);
+        REQUIRE(buf_other.to_str() == "hello world");
+    }
 }
 
 TEST_CASE("Operator Print", "[Operator Overloads]") {
@@ -188,7 +642,13 @@ TEST_CASE("Operator Squacket", "[Operator Overloads]") {
 
     REQUIRE(buf[0] == 'h');
     REQUIRE(buf[5] == ' ');
-    REQUIRE_THROWS_AS(buf[12], std::out_of_range);
+    REQUIRE(buf[10] == 'd');
+
+    buf.move_gap_to(4);
+    REQUIRE(buf[3] == 'l');
+    REQUIRE(buf[4] == 'o');
+    buf[4] = 'O';
+    REQUIRE(buf.to_str() == "hellO world");
 }
 
 TEST_CASE("Operator Squacket (Const)", "[Operator Overloads]") {
@@ -197,7 +657,7 @@ TEST_CASE("Operator Squacket (Const)", "[Operator Overloads]") {
 
     REQUIRE(buf[0] == 'h');
     REQUIRE(buf[5] == ' ');
-    REQUIRE_THROWS_AS(buf[12], std::out_of_range);
+    REQUIRE(buf[10] == 'd');
 }
 
 TEST_CASE("Operator eq", "[Operator Overloads]") {
@@ -217,6 +677,24 @@ TEST_CASE("Operator eq", "[Operator Overloads]") {
     REQUIRE_FALSE(buf1 == buf2);
 }
 
+TEST_CASE("Operator eq (Gap positions)", "[Operator Overloads]") {
+    auto buf1 = Gapbuffer("lorem ipsum dolor");
+    auto buf2 = Gapbuffer("lorem ipsum dolor");
+
+    for (std::size_t i = 0; i <= buf1.size(); i++) {
+        buf1.move_gap_to(i);
+        for (std::size_t j = 0; j <= buf2.size(); j++) {
+            buf2.move_gap_to(j);
+            REQUIRE(buf1 == buf2);
+        }
+    }
+
+    buf2[16] = 'R';
+    buf1.move_gap_to(3);
+    buf2.move_gap_to(12);
+    REQUIRE_FALSE(buf1 == buf2);
+}
+
 TEST_CASE("Operator ne", "[Operator Overloads]") {
     auto buf1 = Gapbuffer("Hello world");
     auto buf2 = Gapbuffer("Hello world");
@@ -241,6 +719,8 @@ TEST_CASE("At", "[Element Access]") {
 
         REQUIRE(buf.at(0) == 'h');
         REQUIRE(buf.at(5) == ' ');
+        REQUIRE(buf.at(10) == 'd');
+        REQUIRE_THROWS_AS(buf.at(11), std::out_of_range);
         REQUIRE_THROWS_AS(buf.at(21), std::out_of_range);
     }
 
@@ -269,6 +749,36 @@ TEST_CASE("At (Const)", "[Element Access]") {
     REQUIRE_THROWS_AS(buf.at(21), std::out_of_range);
 }
 
+TEST_CASE("Data At", "[Element Access]") {
+    auto buf = Gapbuffer("hello world");
+    buf.move_gap_to(5);
+
+    SECTION("Runs stop at the gap") {
+        const auto run = buf.data_at(2);
+        REQUIRE(std::string_view(run.data(), run.size()) == "llo");
+
+        const auto rest = buf.data_at(5);
+        REQUIRE(std::string_view(rest.data(), rest.size()) == " world");
+        REQUIRE(std::as_const(buf).data_at(7).size() == 4);
+    }
+
+    SECTION("Runs are writable") {
+        for (char& c : buf.data_at(6)) {
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        REQUIRE(buf.to_str() == "hello WORLD");
+    }
+
+    SECTION("End of the buffer") {
+        REQUIRE(buf.data_at(11).empty());
+        REQUIRE_THROWS_AS(buf.data_at(12), std::out_of_range);
+
+        buf.move_gap_to(11);
+        REQUIRE(buf.data_at(0).size() == 11);
+        REQUIRE(buf.data_at(11).empty());
+    }
+}
+
 TEST_CASE("Front", "[Element Access]") {
     auto buf = Gapbuffer();
     REQUIRE_THROWS_AS(buf.front(), std::out_of_range);
@@ -313,6 +823,158 @@ TEST_CASE("to_str", "[Element Access]") {
     REQUIRE(buf.to_str() == "hello world___");
 }
 
+TEST_CASE("segments", "[Element Access]") {
+    auto buf = Gapbuffer("hello world");
+
+    SECTION("Gap at the end") {
+        const auto [lhs, rhs] = buf.segments();
+        REQUIRE(std::string_view(lhs.data(), lhs.size()) == "hello world");
+        REQUIRE(rhs.empty());
+    }
+
+    SECTION("Gap in the middle") {
+        buf.move_gap_to(4);
+        const auto [lhs, rhs] = buf.segments();
+        REQUIRE(std::string_view(lhs.data(), lhs.size()) == "hell");
+        REQUIRE(std::string_view(rhs.data(), rhs.size()) == "o world");
+    }
+
+    SECTION("Gap at the start") {
+        buf.move_gap_to(0);
+        const auto [lhs, rhs] = buf.segments();
+        REQUIRE(lhs.empty());
+        REQUIRE(std::string_view(rhs.data(), rhs.size()) == "hello world");
+    }
+}
+
+TEST_CASE("for_each_segment", "[Element Access]") {
+    auto buf = Gapbuffer("hello world");
+    buf.move_gap_to(4);
+
+    SECTION("Visits the segments in order") {
+        std::vector<std::string> seen;
+        const bool completed = std::as_const(buf).for_each_segment([&](std::span<const char> s) {
+            seen.emplace_back(s.begin(), s.end());
+        });
+        REQUIRE(completed);
+        REQUIRE(seen == std::vector<std::string>{"hell", "o world"});
+    }
+
+    SECTION("Empty segments are skipped") {
+        buf.move_gap_to(0);
+        int calls = 0;
+        buf.for_each_segment([&](std::span<char>) { calls++; });
+        REQUIRE(calls == 1);
+    }
+
+    SECTION("Stops when asked to") {
+        int calls = 0;
+        const bool completed = buf.for_each_segment([&](std::span<char>) {
+            calls++;
+            return false;
+        });
+        REQUIRE_FALSE(completed);
+        REQUIRE(calls == 1);
+    }
+
+    SECTION("Values can be modified") {
+        buf.for_each_segment([](std::span<char> s) {
+            for (char& c : s) {
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+        });
+        REQUIRE(buf.to_str() == "HELLO WORLD");
+    }
+}
+
+TEST_CASE("Segmented Algorithms", "[Iterators]") {
+    const std::string s = "a\nbb\nccc\ndddd\n";
+    const int len = static_cast<int>(s.size());
+    auto buf = Gapbuffer(s);
+
+    // Stepping with ++ so that the gap is skipped
+    const auto nth = [&](int n) {
+        auto it = buf.begin();
+        for (int i = 0; i < n; i++) {
+            ++it;
+        }
+        return it;
+    };
+
+    for (std::size_t gap = 0; gap <= s.size(); gap++) {
+        buf.move_gap_to(gap);
+
+        DYNAMIC_SECTION("count, gap at " << gap) {
+            REQUIRE(count(buf.begin(), buf.end(), '\n') == 4);
+            REQUIRE(count(buf.cbegin(), buf.cend(), 'c') == 3);
+            for (int first = 0; first <= len; first++) {
+                for (int last = first; last <= len; last++) {
+                    const auto expected = std::count(s.begin() + first, s.begin() + last, '\n');
+                    REQUIRE(count(nth(first), nth(last), '\n') == expected);
+                }
+            }
+        }
+
+        DYNAMIC_SECTION("find, gap at " << gap) {
+            for (char c : std::string("abcd\n")) {
+                const auto it = find(buf.begin(), buf.end(), c);
+                REQUIRE(it != buf.end());
+                REQUIRE(*it == c);
+                REQUIRE(it - buf.begin() == static_cast<std::ptrdiff_t>(s.find(c)));
+            }
+            REQUIRE(find(buf.begin(), buf.end(), 'z') == buf.end());
+            REQUIRE(find(nth(3), nth(5), 'a') == nth(5));
+        }
+
+        DYNAMIC_SECTION("copy, gap at " << gap) {
+            std::string out;
+            copy(buf.begin(), buf.end(), std::back_inserter(out));
+            REQUIRE(out == s);
+
+            out.clear();
+            copy(nth(2), nth(9), std::back_inserter(out));
+            REQUIRE(out == s.substr(2, 7));
+        }
+
+        DYNAMIC_SECTION("equal, gap at " << gap) {
+            REQUIRE(equal(buf.begin(), buf.end(), s.begin()));
+            REQUIRE(equal(nth(5), nth(len), s.begin() + 5));
+
+            std::string other = s;
+            other[gap == s.size() ? 0 : gap] = 'x';
+            REQUIRE_FALSE(equal(buf.begin(), buf.end(), other.begin()));
+        }
+    }
+}
+
+TEST_CASE("write_to", "[Element Access]") {
+    auto buf = Gapbuffer("hello world\nlorem ipsum");
+    buf.move_gap_to(7);
+
+    SECTION("Stream") {
+        std::ostringstream oss;
+        buf.write_to(oss);
+        REQUIRE(oss.str() == "hello world\nlorem ipsum");
+    }
+
+    SECTION("File descriptor") {
+        const auto path = std::filesystem::temp_directory_path() / "gapbuffer_write_to.txt";
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        REQUIRE(fd != -1);
+        buf.write_to(fd);
+        ::close(fd);
+
+        std::ifstream file(path, std::ios::binary);
+        const std::string contents((std::istreambuf_iterator<char>(file)), {});
+        REQUIRE(contents == "hello world\nlorem ipsum");
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Bad file descriptor") {
+        REQUIRE_THROWS_AS(buf.write_to(-1), std::system_error);
+    }
+}
+
 TEST_CASE("line", "[Element Access]") {
     SECTION("Newline at start and end") {
         std::string s = "lorem ipsum\r\ndolor sit amet\r\nfoo bar baz";
@@ -353,6 +1015,91 @@ TEST_CASE("line", "[Element Access]") {
     }
 }
 
+TEST_CASE("line_view", "[Element Access]") {
+    const std::string s = "lorem ipsum\ndolor sit amet\n\nfoo bar baz";
+    auto buf = Gapbuffer(s);
+
+    SECTION("Agrees with line() for every gap position") {
+        for (std::size_t gap = 0; gap <= s.size(); gap++) {
+            buf.move_gap_to(gap);
+            for (std::size_t pos = 0; pos <= s.size(); pos++) {
+                const auto view = buf.line_view(pos);
+                REQUIRE(view == buf.line(pos));
+                REQUIRE(view.to_str() == buf.line(pos));
+                REQUIRE(view.start == buf.line_start(buf.line_of(pos)));
+            }
+        }
+    }
+
+    SECTION("Pieces are split at the gap") {
+        buf.move_gap_to(16);
+        const auto view = buf.line_view(14);
+        REQUIRE(view.left == "dolo");
+        REQUIRE(view.right == "r sit amet\n");
+        REQUIRE(view.size() == 15);
+        REQUIRE(view[3] == 'o');
+        REQUIRE(view[4] == 'r');
+    }
+
+    SECTION("Errors") {
+        REQUIRE_THROWS_AS(buf.line_view(s.size() + 1), std::out_of_range);
+        REQUIRE_THROWS_AS(Gapbuffer().line_view(0), std::runtime_error);
+    }
+}
+
+TEST_CASE("lines", "[Element Access]") {
+    static_assert(std::ranges::forward_range<Gapbuffer::LineRange>);
+    static_assert(std::ranges::view<Gapbuffer::LineRange>);
+
+    const std::string s = "lorem ipsum\ndolor sit amet\n\nfoo bar baz";
+    const std::vector<std::string> expected = {"lorem ipsum\n", "dolor sit amet\n", "\n",
+                                               "foo bar baz"};
+    auto buf = Gapbuffer(s);
+
+    for (bool indexed : {false, true}) {
+        if (indexed) {
+            buf.enable_line_index();
+        }
+
+        for (std::size_t gap = 0; gap <= s.size(); gap += 3) {
+            buf.move_gap_to(gap);
+
+            std::vector<std::string> all;
+            for (const auto line : buf.lines()) {
+                all.push_back(line.to_str());
+            }
+            REQUIRE(all == expected);
+            REQUIRE(std::ranges::distance(buf.lines()) == buf.line_count());
+
+            auto middle = buf.lines(1, 3);
+            REQUIRE(std::ranges::distance(middle) == 2);
+            REQUIRE(*middle.begin() == "dolor sit amet\n");
+            REQUIRE(middle.front().start == 12);
+            REQUIRE(buf.lines(4, 4).empty());
+            REQUIRE(buf.lines(3, 4).front() == "foo bar baz");
+        }
+    }
+
+    SECTION("Composes with range adaptors") {
+        auto lengths = buf.lines() | std::views::transform([](auto line) { return line.size(); });
+        REQUIRE(std::vector<std::size_t>(lengths.begin(), lengths.end()) ==
+                std::vector<std::size_t>{12, 15, 1, 11});
+    }
+
+    SECTION("Trailing newline does not start another line") {
+        auto ended = Gapbuffer("a\nb\n");
+        REQUIRE(std::ranges::distance(ended.lines()) == 2);
+        REQUIRE(ended.lines(1, 2).front() == "b\n");
+        REQUIRE_THROWS_AS(ended.lines(0, 3), std::out_of_range);
+        REQUIRE(Gapbuffer().lines().empty());
+    }
+
+    SECTION("Errors") {
+        REQUIRE_THROWS_AS(buf.lines(0, 5), std::out_of_range);
+        REQUIRE_THROWS_AS(buf.lines(2, 1), std::out_of_range);
+    }
+}
+
 TEST_CASE("find", "[Element Access]") {
     std::string s = "lorem ipsum\r\ndolor sit amet\r\nfoo bar baz";
     auto buf = Gapbuffer(s);
@@ -363,6 +1110,140 @@ TEST_CASE("find", "[Element Access]") {
     REQUIRE(buf.find(' ', 0) == 0);
 }
 
+TEST_CASE("find_nth", "[Element Access]") {
+    std::string s = "lorem ipsum\r\ndolor sit amet\r\nfoo bar baz";
+    auto buf = Gapbuffer(s);
+
+    SECTION("Small buffer") {
+        buf.move_gap_to(20);
+        REQUIRE(buf.find_nth('\n', 1) == 12);
+        REQUIRE(buf.find_nth('\n', 2) == 28);
+        REQUIRE(buf.find_nth('\n', 3) == Gapbuffer::npos);
+        REQUIRE(buf.find_nth('o', 4) == 30);
+        REQUIRE(buf.find_nth('q', 1) == Gapbuffer::npos);
+        REQUIRE(buf.find_nth(' ', 0) == Gapbuffer::npos);
+    }
+
+    SECTION("Across many blocks") {
+        std::string big(100000, 'x');
+        for (std::size_t i = 7; i < big.size(); i += 1000) {
+            big[i] = '\n';
+        }
+        auto large = Gapbuffer(big);
+        large.move_gap_to(54321);
+
+        REQUIRE(large.find_nth('\n', 1) == 7);
+        REQUIRE(large.find_nth('\n', 55) == 54007);
+        REQUIRE(large.find_nth('\n', 100) == 99007);
+        REQUIRE(large.find_nth('\n', 101) == Gapbuffer::npos);
+    }
+}
+
+TEST_CASE("find (Substring)", "[Element Access]") {
+    std::string s = "lorem ipsum dolor sit amet, lorem ipsum";
+
+    SECTION("Agrees with std::string for every gap position") {
+        auto buf = Gapbuffer(s);
+        const std::vector<std::string> needles = {"lorem", "m d", "ipsum", "t, l", "x", "", s};
+        for (const auto& needle : needles) {
+            for (std::size_t gap = 0; gap <= s.size(); gap++) {
+                buf.move_gap_to(gap);
+                for (std::size_t from = 0; from <= s.size() + 1; from++) {
+                    REQUIRE(buf.find(needle, from) == s.find(needle, from));
+                }
+            }
+        }
+    }
+
+    SECTION("Match straddling the gap") {
+        auto buf = Gapbuffer(s);
+        buf.move_gap_to(14);
+        REQUIRE(buf.find("dolor") == 12);
+        REQUIRE(buf.find("dolor", 13) == Gapbuffer::npos);
+    }
+}
+
+TEST_CASE("rfind", "[Element Access]") {
+    std::string s = "lorem ipsum dolor sit amet, lorem ipsum";
+    auto buf = Gapbuffer(s);
+    const std::vector<std::string> needles = {"lorem", "m d", "ipsum", "t, l", "x", "", s};
+
+    for (const auto& needle : needles) {
+        for (std::size_t gap = 0; gap <= s.size(); gap++) {
+            buf.move_gap_to(gap);
+            REQUIRE(buf.rfind(needle) == s.rfind(needle));
+            for (std::size_t from = 0; from <= s.size() + 1; from++) {
+                REQUIRE(buf.rfind(needle, from) == s.rfind(needle, from));
+            }
+        }
+    }
+}
+
+TEST_CASE("count", "[Element Access]") {
+    std::string big(200000, 'x');
+    for (std::size_t i = 0; i < big.size(); i += 3) {
+        big[i] = 'y';
+    }
+    auto buf = Gapbuffer(big);
+    REQUIRE(buf.count('y') == 66667);
+    REQUIRE(buf.count('z') == 0);
+
+    buf.move_gap_to(100001);
+    REQUIRE(buf.count('y') == 66667);
+    REQUIRE(buf.count('x') == 133333);
+}
+
+TEST_CASE("Parallel Scans", "[Element Access]") {
+    std::mt19937 rng(23);
+    std::string big(50000, 'x');
+    for (auto& c : big) {
+        if (rng() % 50 == 0) {
+            c = '\n';
+        }
+    }
+    auto buf = Gapbuffer(big);
+    buf.reserve(big.size() + 100);
+
+    // Small chunks and no size cutoff so every call really splits, with a chunk straddling the gap
+    const GapbufferParallel par{.threads = 4, .chunk = 1000, .min_size = 0};
+    const std::size_t newlines = buf.count('\n');
+
+    for (std::size_t gap : {std::size_t(0), std::size_t(12345), big.size()}) {
+        buf.move_gap_to(gap);
+        REQUIRE(buf.count(par, '\n') == newlines);
+        REQUIRE(buf.count(par, 'x') == big.size() - newlines);
+        REQUIRE(buf.count(par, 'z') == 0);
+        REQUIRE(buf.line_count(par) == buf.line_count());
+
+        for (std::size_t n : {std::size_t(1), std::size_t(2), newlines / 3, newlines - 1, newlines}) {
+            REQUIRE(buf.find_nth(par, '\n', n) == buf.find_nth('\n', n));
+        }
+        REQUIRE(buf.find_nth(par, '\n', newlines + 1) == Gapbuffer::npos);
+        REQUIRE(buf.find_nth(par, '\n', 0) == Gapbuffer::npos);
+        REQUIRE(buf.find(par, '\n', 20) == buf.find('\n', 20));
+        REQUIRE(buf.find(par, 'z') == -1);
+    }
+
+    SECTION("Occurrence on a chunk boundary") {
+        std::string edges(10000, 'x');
+        edges[999] = edges[1000] = edges[5999] = 'y';
+        auto other = Gapbuffer(edges);
+        other.move_gap_to(1000);
+        REQUIRE(other.find_nth(par, 'y', 1) == 999);
+        REQUIRE(other.find_nth(par, 'y', 2) == 1000);
+        REQUIRE(other.find_nth(par, 'y', 3) == 5999);
+        REQUIRE(other.find_nth(par, 'y', 4) == Gapbuffer::npos);
+    }
+
+    SECTION("Small buffers stay serial") {
+        auto small = Gapbuffer("a\nb\nc");
+        REQUIRE(small.count(gapbuffer_parallel, '\n') == 2);
+        REQUIRE(small.find_nth(gapbuffer_parallel, '\n', 2) == 3);
+        REQUIRE(small.line_count(gapbuffer_parallel) == 3);
+        REQUIRE(Gapbuffer().line_count(par) == 0);
+    }
+}
+
 TEST_CASE("Begin", "[Iterators]") {
     std::string s = "hello world";
     auto buf = Gapbuffer(s);
@@ -376,14 +1257,66 @@ TEST_CASE("End", "[Iterators]") {
     auto buf = Gapbuffer(s);
 
     SECTION("Initial buffer") {
-        REQUIRE(*(buf.end() - 9) == 'd');
-        REQUIRE(*(buf.end() - 10) == 'l');
+        REQUIRE(*(buf.end() - 1) == 'd');
+        REQUIRE(*(buf.end() - 2) == 'l');
     }
 
     SECTION("Move gap") {
         buf.retreat();
-        REQUIRE(*(buf.end() - 9) == 'd');
-        REQUIRE(*(buf.end() - 10) == 'l');
+        REQUIRE(*(buf.end() - 1) == 'd');
+        REQUIRE(*(buf.end() - 2) == 'l');
+    }
+}
+
+TEST_CASE("Arithmetic Across The Gap", "[Iterators]") {
+    const std::string s = "hello world";
+    auto buf = Gapbuffer(s);
+    buf.move_gap_to(5);
+
+    SECTION("Offsets") {
+        for (std::size_t k = 0; k < s.size(); k++) {
+            const auto n = static_cast<std::ptrdiff_t>(k);
+            REQUIRE(*(buf.begin() + n) == s[k]);
+            REQUIRE(*(n + buf.begin()) == s[k]);
+            REQUIRE(*(buf.end() - (11 - n)) == s[k]);
+            REQUIRE(buf.begin()[n] == s[k]);
+            REQUIRE((buf.begin() + n) - buf.begin() == n);
+            REQUIRE(buf.end() - (buf.begin() + n) == 11 - n);
+        }
+        REQUIRE(buf.begin() + 11 == buf.end());
+        REQUIRE(buf.end() - buf.begin() == 11);
+    }
+
+    SECTION("Compound assignment") {
+        auto it = buf.begin();
+        it += 7;
+        REQUIRE(*it == 'o');
+        it -= 4;
+        REQUIRE(*it == 'l');
+        it += 2;
+        REQUIRE(*it == ' ');
+        REQUIRE(it == buf.begin() + 5);
+    }
+
+    SECTION("Decrement") {
+        auto it = buf.begin() + 5;
+        REQUIRE(*--it == 'o');
+        REQUIRE(*it-- == 'o');
+        REQUIRE(*it == 'l');
+
+        std::string reversed;
+        for (auto r = buf.end(); r != buf.begin();) {
+            reversed += *--r;
+        }
+        REQUIRE(reversed == std::string(s.rbegin(), s.rend()));
+    }
+
+    SECTION("Standard algorithms") {
+        std::sort(buf.begin(), buf.end());
+        REQUIRE(buf.to_str() == " dehllloorw");
+        REQUIRE(buf.pos() == 5);
+        REQUIRE(std::lower_bound(buf.begin(), buf.end(), 'l') - buf.begin() == 4);
+        REQUIRE(std::upper_bound(buf.begin(), buf.end(), 'l') - buf.begin() == 7);
     }
 }
 
@@ -400,8 +1333,8 @@ TEST_CASE("End (const)", "[Iterators]") {
     const auto buf = Gapbuffer(s);
 
     SECTION("initial buffer") {
-        REQUIRE(*(buf.end() - 9) == 'd');
-        REQUIRE(*(buf.end() - 8) == 0);
+        REQUIRE(*(buf.end() - 1) == 'd');
+        REQUIRE(buf.end() - 11 == buf.begin());
     }
 }
 
@@ -417,7 +1350,7 @@ TEST_CASE("Cend", "[Iterators]") {
     std::string s = "hello world";
     const auto buf = Gapbuffer(s);
 
-    REQUIRE(*(buf.cend() - 9) == 'd');
+    REQUIRE(*(buf.cend() - 1) == 'd');
 }
 
 TEST_CASE("Rbegin", "[Iterators]") {
@@ -529,6 +1462,239 @@ TEST_CASE("Reserve", "[Capacity]") {
         REQUIRE(buf.capacity() == 32);
     }
 }
+#ifdef GAPBUFFER_STATS
+TEST_CASE("Stats", "[Capacity]") {
+    auto buf = Gapbuffer(std::string(100, 'a'));
+    REQUIRE(buf.stats().edits == 0);
+
+    SECTION("Gap movement") {
+        buf.move_gap_to(40);
+        buf.retreat();
+        buf.advance();
+        buf.move_gap_to(40);
+
+        const auto stats = buf.stats();
+        REQUIRE(stats.gap_moves == 3);
+        REQUIRE(stats.gap_distance == 62);
+        REQUIRE(stats.bytes_moved == 62);
+    }
+
+    SECTION("Edits") {
+        buf.insert(10, "hello");
+        buf.push_back('x');
+        buf.pop_back();
+        buf.erase(5);
+
+        const auto stats = buf.stats();
+        REQUIRE(stats.edits == 4);
+        REQUIRE(stats.average_gap_distance() == 90.0 / 4);
+
+        std::uint64_t inserts = 0;
+        for (auto n : stats.time_of(GapbufferStats::Op::insert)) {
+            inserts += n;
+        }
+        REQUIRE(inserts == 1);
+    }
+
+    SECTION("Reallocations") {
+        buf.insert(std::string(100, 'b'));
+        buf.erase(150);
+        buf.shrink_to_fit();
+
+        const auto stats = buf.stats();
+        REQUIRE(stats.reallocations == 2);
+        REQUIRE(stats.bytes_reallocated == 100 + 50);
+    }
+
+    SECTION("Reset") {
+        buf.push_back('x');
+        buf.reset_stats();
+        REQUIRE(buf.stats().edits == 0);
+    }
+}
+#endif
+
+TEST_CASE("Shrink To Fit", "[Capacity]") {
+    auto buf = Gapbuffer(std::string(100, 'a'));
+    buf.move_gap_to(50);
+    buf.erase(40);
+    REQUIRE(buf.capacity() == 108);
+
+    buf.shrink_to_fit();
+    REQUIRE(buf.capacity() == 60 + GapbufferGrowth<>::min_gap);
+    REQUIRE(buf.pos() == 10);
+    REQUIRE(buf.to_str() == std::string(60, 'a'));
+
+    SECTION("Already tight is a no-op") {
+        buf.shrink_to_fit();
+        REQUIRE(buf.capacity() == 68);
+    }
+
+    SECTION("Can still grow afterwards") {
+        buf.insert(std::string(20, 'b'));
+        REQUIRE(buf.size() == 80);
+        REQUIRE(buf.to_str() == std::string(10, 'a') + std::string(20, 'b') + std::string(50, 'a'));
+    }
+}
+TEST_CASE("Growth Policy", "[Capacity]") {
+    SECTION("Minimum gap from constructors") {
+        using Wide = BasicGapbuffer<char, std::allocator<char>, GapbufferGrowth<64>>;
+        auto buf = Wide(std::string_view("hello"));
+        REQUIRE(buf.capacity() == 69);
+        REQUIRE(buf.gap_size() == 64);
+    }
+
+    SECTION("Growth factor") {
+        using Slow = BasicGapbuffer<char, std::allocator<char>, GapbufferGrowth<8, 150>>;
+        auto buf = Slow(16);
+        for (int i = 0; i < 16; i++) {
+            buf.push_back('a');
+        }
+        REQUIRE(buf.capacity() == 24);
+        REQUIRE(buf.size() == 16);
+    }
+
+    SECTION("Gap is capped") {
+        using Capped = BasicGapbuffer<char, std::allocator<char>, GapbufferGrowth<8, 200, 10>>;
+        auto buf = Capped(std::string(1000, 'a'));
+        buf.insert(std::string(100, 'b'));
+        REQUIRE(buf.size() == 1100);
+        REQUIRE(buf.capacity() == 1100 + 110);
+    }
+
+    SECTION("Policy arithmetic") {
+        STATIC_REQUIRE(GapbufferGrowth<>::grow(0, 0) == 1);
+        STATIC_REQUIRE(GapbufferGrowth<>::grow(32, 32) == 64);
+        STATIC_REQUIRE(GapbufferGrowth<>::grow(32, 100) == 128);
+        STATIC_REQUIRE(GapbufferGrowth<8, 200, 10>::grow(32, 100) == 110);
+    }
+}
+#ifdef GAPBUFFER_HAS_MREMAP
+TEST_CASE("Huge Page Storage", "[Capacity]") {
+    using Paged = BasicGapbuffer<char, std::allocator<char>, GapbufferGrowth<8, 200, 0, 1 << 16>>;
+    constexpr std::size_t huge_page = 2 << 20;
+
+    std::mt19937 rng(28);
+    std::string model(5000, ' ');
+    for (char& c : model) {
+        c = static_cast<char>('a' + rng() % 26);
+    }
+    auto paged = [](const Paged& buf) {
+        return buf.is_page_mapped() && buf.capacity() % huge_page == 0 &&
+               reinterpret_cast<std::uintptr_t>(buf.data_at(0).data()) % 4096 == 0;
+    };
+
+    SECTION("Small buffers stay with the allocator") {
+        auto buf = Paged(model);
+        buf.reserve(10000);
+        REQUIRE_FALSE(buf.is_page_mapped());
+        REQUIRE_FALSE(buf.is_mapped());
+    }
+
+    SECTION("Growing past the threshold maps and remaps") {
+        auto buf = Paged(model);
+        buf.move_gap_to(1234);
+        buf.reserve(1 << 16);
+        REQUIRE(paged(buf));
+        REQUIRE_FALSE(buf.is_mapped());
+        REQUIRE(buf.pos() == 1234);
+        REQUIRE(buf.to_str() == model);
+
+        // Grow repeatedly with the gap in the middle, so the right half has to follow the end
+        for (int i = 0; i < 4; i++) {
+            const std::string value(3 * huge_page / 2, static_cast<char>('A' + i));
+            buf.insert(value);
+            model.insert(buf.pos() - value.size(), value);
+            REQUIRE(paged(buf));
+            REQUIRE(buf.size() == model.size());
+        }
+        REQUIRE(buf.to_str() == model);
+
+        buf.move_gap_to(100);
+        buf.erase(50);
+        model.erase(50, 50);
+        buf.shrink_to_fit();
+        REQUIRE(paged(buf));
+        REQUIRE(buf.to_str() == model);
+    }
+
+#ifdef GAPBUFFER_STATS
+    SECTION("Remapping only writes the right half") {
+        auto buf = Paged(model);
+        buf.reserve(1 << 16);
+        buf.move_gap_to(1000);
+        buf.reset_stats();
+
+        buf.reserve(buf.capacity() * 2);
+        REQUIRE(buf.stats().reallocations == 1);
+        REQUIRE(buf.stats().bytes_reallocated == model.size() - 1000);
+        REQUIRE(buf.to_str() == model);
+    }
+#endif
+
+    SECTION("Shrinking below the threshold goes back to the allocator") {
+        auto buf = Paged(model);
+        buf.reserve(1 << 20);
+        REQUIRE(buf.is_page_mapped());
+        buf.shrink_to_fit();
+        REQUIRE_FALSE(buf.is_page_mapped());
+        REQUIRE(buf.capacity() < (1 << 16));
+        REQUIRE(buf.to_str() == model);
+    }
+
+    SECTION("Copies, moves and snapshots") {
+        auto buf = Paged(model);
+        buf.reserve(1 << 20);
+
+        const auto snap = buf.snapshot();
+        buf.move_gap_to(10);
+        buf.insert(std::string(3 * huge_page, 'z'));
+        REQUIRE(paged(buf));
+        REQUIRE(snap.to_str() == model);
+        REQUIRE(buf.to_str() == model.substr(0, 10) + std::string(3 * huge_page, 'z') +
+                                    model.substr(10));
+
+        const auto copy = buf;
+        REQUIRE(copy.to_str() == buf.to_str());
+
+        auto moved = std::move(buf);
+        REQUIRE(paged(moved));
+        moved.push_back('!');
+        REQUIRE(moved.size() == copy.size() + 1);
+
+        auto other = Paged("x");
+        other.swap(moved);
+        REQUIRE(paged(other));
+        REQUIRE_FALSE(moved.is_page_mapped());
+        REQUIRE(moved.to_str() == "x");
+    }
+
+    SECTION("File mappings are copied out, not remapped") {
+        const auto path = std::filesystem::temp_directory_path() / "gapbuffer_huge_pages.txt";
+        {
+            std::ofstream file(path, std::ios::binary);
+            file << model;
+        }
+        auto buf = Paged::from_file(path);
+        REQUIRE(buf.is_mapped());
+        buf.reserve(1 << 16);
+        REQUIRE_FALSE(buf.is_mapped());
+        REQUIRE(paged(buf));
+        REQUIRE(buf.to_str() == model);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Non-trivial values ignore the threshold") {
+        using PagedStrings =
+            BasicGapbuffer<std::string, std::allocator<std::string>, GapbufferGrowth<8, 200, 0, 1>>;
+        auto buf = PagedStrings();
+        buf.push_back("hello");
+        buf.reserve(1000);
+        REQUIRE_FALSE(buf.is_page_mapped());
+        REQUIRE(buf[0] == "hello");
+    }
+}
+#endif
 TEST_CASE("Line Count", "[Capacity]") {
     SECTION("Empty") {
         auto buf = Gapbuffer();
@@ -548,6 +1714,233 @@ TEST_CASE("Line Count", "[Capacity]") {
     }
 }
 
+TEST_CASE("Line Of", "[Capacity]") {
+    auto buf = Gapbuffer("lorem\nipsum\n\ndolor");
+
+    REQUIRE(buf.line_of(0) == 0);
+    REQUIRE(buf.line_of(5) == 0);
+    REQUIRE(buf.line_of(6) == 1);
+    REQUIRE(buf.line_of(12) == 2);
+    REQUIRE(buf.line_of(13) == 3);
+    REQUIRE(buf.line_of(buf.size()) == 3);
+    REQUIRE_THROWS_AS(buf.line_of(buf.size() + 1), std::out_of_range);
+}
+
+TEST_CASE("Line Start", "[Capacity]") {
+    auto buf = Gapbuffer("lorem\nipsum\n\ndolor");
+    buf.move_gap_to(8);
+
+    REQUIRE(buf.line_start(0) == 0);
+    REQUIRE(buf.line_start(1) == 6);
+    REQUIRE(buf.line_start(2) == 12);
+    REQUIRE(buf.line_start(3) == 13);
+    REQUIRE_THROWS_AS(buf.line_start(4), std::out_of_range);
+}
+
+TEST_CASE("Line Index", "[Capacity]") {
+    std::string s = "lorem ipsum\r\ndolor sit amet\r\nfoo bar baz";
+    auto buf = Gapbuffer(s);
+    auto indexed = Gapbuffer(s);
+    indexed.enable_line_index();
+    REQUIRE(indexed.has_line_index());
+
+    auto check = [&]() {
+        REQUIRE(indexed.to_str() == buf.to_str());
+        REQUIRE(indexed.line_count() == buf.line_count());
+        for (std::size_t i = 0; i <= buf.size(); i++) {
+            REQUIRE(indexed.line_of(i) == buf.line_of(i));
+        }
+        for (std::size_t i = 0; i < buf.line_count(); i++) {
+            REQUIRE(indexed.line_start(i) == buf.line_start(i));
+        }
+        if (!buf.empty()) {
+            REQUIRE(indexed.line(buf.size() / 2) == buf.line(buf.size() / 2));
+        }
+    };
+
+    std::vector<std::function<void(Gapbuffer&)>> edits = {
+        [](Gapbuffer& b) { b.move_gap_to(5); },
+        [](Gapbuffer& b) { b.insert("\n\nnew\nlines"); },
+        [](Gapbuffer& b) { b.push_back('\n'); },
+        [](Gapbuffer& b) { b.move_gap_to(30); },
+        [](Gapbuffer& b) { b.erase(18); },
+        [](Gapbuffer& b) { b.pop_back(); },
+        [](Gapbuffer& b) { b.insert(0, "\nheader\n"); },
+        [](Gapbuffer& b) { b.move_gap_to(b.size()); },
+        [](Gapbuffer& b) { b.insert(std::string(40, '\n')); },
+        [](Gapbuffer& b) { b.move_gap_to(3); },
+        [](Gapbuffer& b) { b.clear(); },
+        [](Gapbuffer& b) { b.insert("after\nclear"); },
+    };
+
+    check();
+    for (auto& edit : edits) {
+        edit(buf);
+        edit(indexed);
+        check();
+    }
+
+    SECTION("Copies keep the index") {
+        auto copy = indexed;
+        REQUIRE(copy.has_line_index());
+        REQUIRE(copy.line_start(1) == 6);
+    }
+
+    SECTION("Disabling falls back to scanning") {
+        indexed.disable_line_index();
+        REQUIRE_FALSE(indexed.has_line_index());
+        REQUIRE(indexed.line_count() == 2);
+    }
+}
+
+// Byte offsets at which each code point of `s` starts
+static std::vector<std::size_t> codepoint_starts(const std::string& s) {
+    std::vector<std::size_t> ret;
+    for (std::size_t i = 0; i < s.size(); i++) {
+        if ((static_cast<unsigned char>(s[i]) & 0xC0) != 0x80) {
+            ret.push_back(i);
+        }
+    }
+    return ret;
+}
+
+// Mixed one to four byte code points with a newline now and then
+static std::string random_utf8(std::mt19937& rng, std::size_t codepoints) {
+    const std::array<std::string, 6> pieces = {"a", "\n", "\xC3\xA9", "\xE2\x82\xAC",
+                                               "\xF0\x9F\x98\x80", "z"};
+    std::string ret;
+    for (std::size_t i = 0; i < codepoints; i++) {
+        ret += pieces[rng() % (rng() % 8 == 0 ? pieces.size() : 3 + rng() % 3)];
+    }
+    return ret;
+}
+
+TEST_CASE("UTF-8", "[Capacity]") {
+    // "a", "é", "€", "😀", "\n", "b"
+    const std::string s = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\nb";
+    auto buf = Gapbuffer(s);
+    buf.move_gap_to(4);
+
+    SECTION("Offsets") {
+        REQUIRE(buf.codepoint_count() == 6);
+        REQUIRE(buf.codepoint_offset(0) == 0);
+        REQUIRE(buf.codepoint_offset(3) == 2);
+        REQUIRE(buf.codepoint_offset(4) == 3);  // Inside the euro sign
+        REQUIRE(buf.codepoint_offset(s.size()) == 6);
+        REQUIRE(buf.byte_offset(2) == 3);
+        REQUIRE(buf.byte_offset(3) == 6);
+        REQUIRE(buf.byte_offset(6) == s.size());
+        REQUIRE_THROWS_AS(buf.byte_offset(7), std::out_of_range);
+        REQUIRE_THROWS_AS(buf.codepoint_offset(s.size() + 1), std::out_of_range);
+    }
+
+    SECTION("Columns") {
+        REQUIRE(buf.column(0) == 0);
+        REQUIRE(buf.column(6) == 3);
+        REQUIRE(buf.column(10) == 4);
+        REQUIRE(buf.column(11) == 0);
+        REQUIRE(buf.column(12) == 1);
+        buf.enable_line_index();
+        REQUIRE(buf.column(10) == 4);
+        REQUIRE(buf.column(12) == 1);
+    }
+
+    SECTION("Moving the gap") {
+        buf.move_gap_to(0);
+        buf.move_gap_codepoints(3);
+        REQUIRE(buf.pos() == 6);
+        buf.move_gap_codepoints(3);
+        REQUIRE(buf.pos() == s.size());
+        REQUIRE_THROWS_AS(buf.move_gap_codepoints(1), std::out_of_range);
+        buf.move_gap_codepoints(-2);
+        REQUIRE(buf.pos() == 10);
+        REQUIRE_THROWS_AS(buf.move_gap_codepoints(-5), std::out_of_range);
+        REQUIRE(buf.pos() == 10);
+        buf.move_gap_codepoints(-4);
+        REQUIRE(buf.pos() == 0);
+
+        // From inside a code point, to the start of the next or previous one
+        buf.move_gap_to(4);
+        buf.move_gap_codepoints(1);
+        REQUIRE(buf.pos() == 6);
+        buf.move_gap_to(4);
+        buf.move_gap_codepoints(-1);
+        REQUIRE(buf.pos() == 3);
+    }
+
+    SECTION("Index follows edits") {
+        std::mt19937 rng(25);
+        std::string model = random_utf8(rng, 6000);
+        auto big = Gapbuffer(model);
+        auto indexed = Gapbuffer(model);
+        indexed.enable_codepoint_index();
+        REQUIRE(indexed.has_codepoint_index());
+
+        for (int round = 0; round < 60; round++) {
+            const auto starts = codepoint_starts(model);
+            const std::size_t at = starts[rng() % starts.size()];
+            if (rng() % 3 == 0 && at > 0) {
+                const std::size_t count = std::min<std::size_t>(at, rng() % 6000);
+                const std::size_t from = at - count;
+                if ((static_cast<unsigned char>(model[from]) & 0xC0) != 0x80) {
+                    indexed.move_gap_to(at);
+                    indexed.erase(count);
+                    model.erase(from, count);
+                }
+            } else {
+                const std::string text = random_utf8(rng, rng() % 3000);
+                indexed.insert(at, text);
+                model.insert(at, text);
+            }
+            indexed.move_gap_to(codepoint_starts(model)[rng() % codepoint_starts(model).size()]);
+
+            const auto now = codepoint_starts(model);
+            REQUIRE(indexed.codepoint_count() == now.size());
+            for (std::size_t i = 0; i < now.size(); i += 97) {
+                REQUIRE(indexed.byte_offset(i) == now[i]);
+                REQUIRE(indexed.codepoint_offset(now[i]) == i);
+            }
+            REQUIRE(indexed.byte_offset(now.size()) == model.size());
+        }
+
+        // The index gives the same answers as scanning
+        big = Gapbuffer(model);
+        big.move_gap_to(indexed.pos());
+        for (std::size_t byte = 0; byte <= model.size(); byte += 101) {
+            REQUIRE(indexed.codepoint_offset(byte) == big.codepoint_offset(byte));
+            REQUIRE(indexed.column(byte) == big.column(byte));
+        }
+
+        indexed.enable_undo();
+        indexed.insert("\xE2\x82\xAC\xE2\x82\xAC");
+        REQUIRE(indexed.undo());
+        REQUIRE(indexed.codepoint_count() == codepoint_starts(model).size());
+
+        const auto copy = indexed;
+        REQUIRE(copy.has_codepoint_index());
+        REQUIRE(copy.codepoint_count() == indexed.codepoint_count());
+        indexed.disable_codepoint_index();
+        REQUIRE_FALSE(indexed.has_codepoint_index());
+    }
+
+    SECTION("Gap moves over long runs") {
+        std::mt19937 rng(2501);
+        const std::string text = random_utf8(rng, 20000);
+        const auto starts = codepoint_starts(text);
+        auto runs = Gapbuffer(text);
+        runs.enable_codepoint_index();
+        runs.move_gap_to(0);
+        runs.move_gap_codepoints(12345);
+        REQUIRE(runs.pos() == starts[12345]);
+        runs.move_gap_codepoints(-12000);
+        REQUIRE(runs.pos() == starts[345]);
+        runs.move_gap_codepoints(static_cast<std::ptrdiff_t>(starts.size() - 345));
+        REQUIRE(runs.pos() == text.size());
+        REQUIRE(runs.codepoint_offset(starts[9999]) == 9999);
+        REQUIRE(runs.byte_offset(19999) == starts[19999]);
+    }
+}
+
 TEST_CASE("Clear", "[Modifiers]") {
     std::string s = "hello world";
     auto buf = Gapbuffer(s);
@@ -576,6 +1969,141 @@ TEST_CASE("Insert", "[Modifiers]") {
     REQUIRE(buf.capacity() == 64);
 }
 
+TEST_CASE("Insert (Bulk)", "[Modifiers]") {
+    SECTION("Grows a single time to fit") {
+        auto buf = Gapbuffer();
+        buf.insert(std::string(100, '_'));
+
+        REQUIRE(buf.size() == 100);
+        REQUIRE(buf.capacity() == 128);
+        REQUIRE(buf.gap_size() == 28);
+        REQUIRE(buf.to_str() == std::string(100, '_'));
+    }
+
+    SECTION("Into the middle of the buffer") {
+        auto buf = Gapbuffer("hello world");
+        buf.move_gap_to(5);
+        buf.insert(",");
+
+        REQUIRE(buf.to_str() == "hello, world");
+        REQUIRE(buf.pos() == 6);
+    }
+}
+
+TEST_CASE("Insert (Position)", "[Modifiers]") {
+    auto buf = Gapbuffer("hello world");
+
+    buf.insert(0, ">> ");
+    REQUIRE(buf.to_str() == ">> hello world");
+    REQUIRE(buf.pos() == 3);
+
+    buf.insert(buf.size(), " <<");
+    REQUIRE(buf.to_str() == ">> hello world <<");
+
+    buf.insert(8, std::string(40, '-'));
+    REQUIRE(buf.to_str() == ">> hello" + std::string(40, '-') + " world <<");
+    REQUIRE(buf.pos() == 48);
+
+    REQUIRE_THROWS_AS(buf.insert(100, "!"), std::out_of_range);
+}
+
+TEST_CASE("Streaming Ingest", "[Modifiers]") {
+    std::string input;
+    for (int i = 0; i < 20000; i++) {
+        input += "line " + std::to_string(i) + "\n";
+    }
+
+    SECTION("append_chunk") {
+        auto buf = Gapbuffer();
+        buf.enable_line_index();
+        for (std::size_t i = 0; i < input.size(); i += 777) {
+            const std::string chunk = input.substr(i, 777);
+            buf.append_chunk(std::span<const char>(chunk.data(), chunk.size()));
+
+            // Edits between chunks are kept, and the next chunk still lands at the end
+            if (i == 777 * 3) {
+                buf.move_gap_to(5);
+                buf.insert("!");
+                input.insert(5, "!");
+                i++;
+            }
+        }
+        REQUIRE(buf.to_str() == input);
+        REQUIRE(buf.pos() == buf.size());
+        REQUIRE(buf.line_count() == Gapbuffer(input).line_count());
+    }
+
+    SECTION("Stream") {
+        std::istringstream is(input);
+        auto buf = Gapbuffer("> ");
+        REQUIRE(buf.read_from(is) == input.size());
+        REQUIRE(buf.to_str() == "> " + input);
+        REQUIRE(is.eof());
+        REQUIRE(buf.read_from(is) == 0);
+    }
+
+    SECTION("Pipe written to by another thread") {
+        int fds[2];
+        REQUIRE(::pipe(fds) == 0);
+        bool written = true;
+        std::thread writer([&] {
+            for (std::size_t i = 0; i < input.size(); i += 1000) {
+                const std::size_t len = std::min<std::size_t>(1000, input.size() - i);
+                written &= ::write(fds[1], input.data() + i, len) == static_cast<::ssize_t>(len);
+            }
+            ::close(fds[1]);
+        });
+
+        // read_some() hands back whatever has arrived so far, which is readable right away
+        auto buf = Gapbuffer();
+        std::size_t total = 0;
+        while (const std::size_t got = buf.read_some(fds[0])) {
+            total += got;
+            REQUIRE(buf.size() == total);
+            REQUIRE(buf.to_str() == input.substr(0, total));
+        }
+        writer.join();
+        ::close(fds[0]);
+        REQUIRE(written);
+        REQUIRE(buf.to_str() == input);
+    }
+
+    SECTION("File descriptor") {
+        const auto path = std::filesystem::temp_directory_path() / "gapbuffer_read_from.txt";
+        std::ofstream(path, std::ios::binary) << input;
+
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        REQUIRE(fd != -1);
+        auto buf = Gapbuffer();
+        buf.enable_undo();
+        REQUIRE(buf.read_from(fd) == input.size());
+        ::close(fd);
+        std::filesystem::remove(path);
+
+        REQUIRE(buf.to_str() == input);
+        REQUIRE(buf.undo());
+        REQUIRE(buf.empty());
+    }
+
+    SECTION("Snapshots taken while loading keep what had arrived") {
+        auto buf = Gapbuffer();
+        const std::string first = input.substr(0, 5000);
+        buf.append_chunk(std::span<const char>(first.data(), first.size()));
+        const auto snap = buf.snapshot();
+
+        std::istringstream rest(input.substr(5000));
+        buf.read_from(rest);
+        REQUIRE(buf.to_str() == input);
+        REQUIRE(snap.to_str() == first);
+    }
+
+    SECTION("Bad file descriptor") {
+        auto buf = Gapbuffer("abc");
+        REQUIRE_THROWS_AS(buf.read_some(-1), std::system_error);
+        REQUIRE(buf.to_str() == "abc");
+    }
+}
+
 TEST_CASE("Erase", "[Modifiers]") {
     std::string s = "hello world";
     auto buf = Gapbuffer(s);
@@ -586,6 +2114,41 @@ TEST_CASE("Erase", "[Modifiers]") {
     REQUIRE(buf.capacity() == 19);
 }
 
+TEST_CASE("Erase (View)", "[Modifiers]") {
+    auto buf = Gapbuffer("hello world");
+
+    SECTION("Returns the removed values in order") {
+        REQUIRE(buf.erase(6) == " world");
+        REQUIRE(buf.to_str() == "hello");
+        REQUIRE(buf.gap_size() == 14);
+    }
+
+    SECTION("From the middle of the buffer") {
+        buf.move_gap_to(5);
+        REQUIRE(buf.erase(2) == "lo");
+        REQUIRE(buf.to_str() == "hel world");
+        REQUIRE(buf.pos() == 3);
+    }
+
+    SECTION("More than precede the gap") {
+        buf.move_gap_to(3);
+        REQUIRE_THROWS_AS(buf.erase(4), std::out_of_range);
+        REQUIRE(buf.to_str() == "hello world");
+    }
+}
+
+TEST_CASE("Erase (Span)", "[Modifiers]") {
+    auto buf = Gapbuffer("hello world");
+    std::array<char, 8> out = {};
+
+    auto written = buf.erase(5, out);
+    REQUIRE(std::string_view(written.data(), written.size()) == "world");
+    REQUIRE(buf.to_str() == "hello ");
+
+    REQUIRE_THROWS_AS(buf.erase(6, std::span<char>(out).first(4)), std::length_error);
+    REQUIRE(buf.to_str() == "hello ");
+}
+
 TEST_CASE("Push Back", "[Modifiers]") {
     std::string s = "hello world";
     auto buf = Gapbuffer(s);
@@ -710,3 +2273,475 @@ TEST_CASE("Retreat", "[Modifiers]") {
         REQUIRE(ss.str() == "[#include <iostream>\r\n\r\nint m ain]");
     }
 }
+
+TEST_CASE("Move Gap To", "[Modifiers]") {
+    std::string s = "hello world";
+    auto buf = Gapbuffer(s);
+    std::stringstream ss;
+
+    SECTION("Towards the start") {
+        buf.move_gap_to(5);
+        REQUIRE(buf.pos() == 5);
+        ss << buf;
+        REQUIRE(ss.str() == "[hello         world]");
+        REQUIRE(buf.to_str() == s);
+    }
+
+    SECTION("To the very start") {
+        buf.move_gap_to(0);
+        REQUIRE(buf.pos() == 0);
+        REQUIRE(buf.front() == 'h');
+        REQUIRE(*buf.begin() == 'h');
+        REQUIRE_FALSE(buf.empty());
+        REQUIRE(buf.to_str() == s);
+    }
+
+    SECTION("Back towards the end") {
+        buf.move_gap_to(2);
+        buf.move_gap_to(9);
+        REQUIRE(buf.pos() == 9);
+        ss << buf;
+        REQUIRE(ss.str() == "[hello wor        ld]");
+        REQUIRE(buf.to_str() == s);
+    }
+
+    SECTION("Further than the gap is wide") {
+        auto big = Gapbuffer();
+        big.insert("0123456789012345678901234567890");
+        big.move_gap_to(3);
+        REQUIRE(big.pos() == 3);
+        REQUIRE(big.to_str() == "0123456789012345678901234567890");
+        big.move_gap_to(28);
+        REQUIRE(big.to_str() == "0123456789012345678901234567890");
+    }
+
+    SECTION("Out of range") {
+        REQUIRE_THROWS_AS(buf.move_gap_to(12), std::out_of_range);
+    }
+}
+
+TEST_CASE("Move Gap", "[Modifiers]") {
+    std::string s = "hello world";
+    auto buf = Gapbuffer(s);
+
+    buf.move_gap(-6);
+    REQUIRE(buf.pos() == 5);
+    buf.move_gap(2);
+    REQUIRE(buf.pos() == 7);
+    REQUIRE(buf.to_str() == s);
+
+    REQUIRE_THROWS_AS(buf.move_gap(-8), std::out_of_range);
+    REQUIRE_THROWS_AS(buf.move_gap(5), std::out_of_range);
+    REQUIRE(buf.pos() == 7);
+}
+
+TEST_CASE("Apply Batch", "[Modifiers]") {
+    using Edit = Gapbuffer::Edit;
+
+    SECTION("Small buffer") {
+        auto buf = Gapbuffer("one two three");
+        const std::array<Edit, 3> edits = {{{0, 3, "1"}, {4, 0, "and "}, {8, 5, "3"}}};
+        buf.apply_batch(edits, 2);
+
+        REQUIRE(buf.to_str() == "1 and two 3");
+        REQUIRE(buf.pos() == 2);
+        REQUIRE(buf.is_inline());
+    }
+
+    SECTION("Cursor past every edit when growing") {
+        const std::string s(100, '.');
+        auto buf = Gapbuffer(s);
+        const std::string more(200, '+');
+        const std::array<Edit, 2> edits = {{{0, 0, more}, {50, 10, "-"}}};
+        buf.apply_batch(edits, 280);
+
+        REQUIRE(buf.to_str() == more + s.substr(0, 50) + "-" + s.substr(60));
+        REQUIRE(buf.pos() == 280);
+    }
+
+    SECTION("Every line of a large buffer") {
+        std::string s;
+        for (int i = 0; i < 100; i++) {
+            s += "line " + std::to_string(i) + "\n";
+        }
+        auto buf = Gapbuffer(s);
+        buf.move_gap_to(s.size() / 2);
+        buf.enable_line_index();
+
+        // Prefix every line and drop the first value of "line"
+        std::vector<Edit> edits;
+        std::string expected;
+        for (std::size_t start = 0; start < s.size(); start = s.find('\n', start) + 1) {
+            edits.push_back({start, 1, "> "});
+        }
+        for (std::size_t start = 0; start < s.size();) {
+            const std::size_t end = s.find('\n', start) + 1;
+            expected += "> " + s.substr(start + 1, end - start - 1);
+            start = end;
+        }
+
+        buf.apply_batch(edits, 10);
+        REQUIRE(buf.to_str() == expected);
+        REQUIRE(buf.pos() == 10);
+        REQUIRE(buf.gap_size() > 0);
+        REQUIRE(buf.line_count() == 100);
+        REQUIRE(buf.line_start(99) == expected.rfind('\n', expected.size() - 2) + 1);
+        REQUIRE(buf.line(buf.size() - 1) == "> ine 99\n");
+    }
+
+    SECTION("Edits that fit are made in place") {
+        auto buf = Gapbuffer(std::string(100, 'x'));
+        buf.reserve(200);
+        const std::string inserted(50, 'a');
+        const std::array<Edit, 2> edits = {{{10, 0, inserted}, {90, 10, "b"}}};
+        buf.apply_batch(edits, 0);
+
+        REQUIRE(buf.capacity() == 200);
+        REQUIRE(buf.size() == 141);
+        REQUIRE(buf.to_str() == std::string(10, 'x') + inserted + std::string(80, 'x') + "b");
+    }
+
+    SECTION("Matches applying every edit on its own") {
+        std::mt19937 rng(19);
+        const std::string s(500, 'x');
+
+        for (int round = 0; round < 20; round++) {
+            auto buf = Gapbuffer(s);
+            if (round % 2 == 0) {
+                buf.reserve(2 * s.size());
+            }
+            buf.move_gap_to(rng() % (s.size() + 1));
+            std::string model = s;
+
+            std::vector<Edit> edits;
+            std::size_t at = 0;
+            while (true) {
+                at += rng() % 40;
+                const std::size_t count = rng() % 5;
+                if (at + count > s.size()) {
+                    break;
+                }
+                edits.push_back({at, count, std::string_view("abcdefgh", rng() % 9)});
+                at += count;
+            }
+            for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+                model.replace(it->pos, it->erase_count, it->text);
+            }
+
+            const std::size_t cursor = rng() % (model.size() + 1);
+            buf.apply_batch(edits, cursor);
+            REQUIRE(buf.to_str() == model);
+            REQUIRE(buf.pos() == cursor);
+        }
+    }
+
+    SECTION("Invalid batches change nothing") {
+        const std::string s(100, 'x');
+        auto buf = Gapbuffer(s);
+        buf.move_gap_to(40);
+
+        const std::array<Edit, 2> overlapping = {{{10, 5, "a"}, {12, 0, "b"}}};
+        REQUIRE_THROWS_AS(buf.apply_batch(overlapping, 0), std::invalid_argument);
+
+        const std::array<Edit, 1> past_end = {{{98, 3, ""}}};
+        REQUIRE_THROWS_AS(buf.apply_batch(past_end, 0), std::out_of_range);
+
+        const std::array<Edit, 1> erase_all = {{{0, 100, "a"}}};
+        REQUIRE_THROWS_AS(buf.apply_batch(erase_all, 2), std::out_of_range);
+
+        REQUIRE(buf.to_str() == s);
+        REQUIRE(buf.pos() == 40);
+    }
+}
+
+TEST_CASE("Undo", "[Modifiers]") {
+    auto buf = Gapbuffer("hello world");
+    buf.move_gap_to(0);
+
+    SECTION("Disabled by default") {
+        buf.insert("!");
+        REQUIRE_FALSE(buf.has_undo());
+        REQUIRE_FALSE(buf.undo());
+        REQUIRE(buf.to_str() == "!hello world");
+    }
+
+    buf.enable_undo();
+    REQUIRE(buf.has_undo());
+    REQUIRE_FALSE(buf.can_undo());
+
+    SECTION("Typing is one step") {
+        buf.move_gap_to(5);
+        for (char c : std::string(", dear")) {
+            buf.push_back(c);
+        }
+        REQUIRE(buf.to_str() == "hello, dear world");
+
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == "hello world");
+        REQUIRE(buf.pos() == 5);
+        REQUIRE_FALSE(buf.can_undo());
+
+        REQUIRE(buf.redo());
+        REQUIRE(buf.to_str() == "hello, dear world");
+        REQUIRE(buf.pos() == 11);
+        REQUIRE_FALSE(buf.redo());
+    }
+
+    SECTION("Deleting is one step") {
+        buf.move_gap_to(11);
+        REQUIRE(buf.pop_back() == 'd');
+        buf.erase(2);
+        REQUIRE(buf.pop_back() == 'o');
+        REQUIRE(buf.to_str() == "hello w");
+
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == "hello world");
+        REQUIRE(buf.pos() == 11);
+
+        REQUIRE(buf.redo());
+        REQUIRE(buf.to_str() == "hello w");
+    }
+
+    SECTION("Separate steps") {
+        buf.insert(0, ">");
+        buf.insert(buf.size(), "<");
+        buf.move_gap_to(6);
+        buf.insert("a");
+        buf.undo_boundary();
+        buf.insert("b");
+        REQUIRE(buf.to_str() == ">helloab world<");
+
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == ">helloa world<");
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == ">hello world<");
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == ">hello world");
+        REQUIRE(buf.undo());
+        REQUIRE(buf.to_str() == "hello world");
+        REQUIRE_FALSE(buf.undo());
+    }
+
+    SECTION("A new edit drops the redo steps") {
+        buf.insert("a");
+        buf.undo_boundary();
+        buf.insert("b");
+        buf.undo();
+        REQUIRE(buf.can_redo());
+
+        buf.insert("c");
+        REQUIRE_FALSE(buf.can_redo());
+        REQUIRE(buf.to_str() == "achello world");
+        buf.undo();
+        REQUIRE(buf.to_str() == "ahello world");
+    }
+
+    SECTION("A batch is one step") {
+        auto big = Gapbuffer(std::string(100, 'x'));
+        big.enable_undo();
+        const std::array<Gapbuffer::Edit, 3> edits = {{{0, 1, "a"}, {50, 0, "b"}, {98, 2, ""}}};
+        big.apply_batch(edits, 0);
+        REQUIRE(big.to_str() == "a" + std::string(49, 'x') + "b" + std::string(48, 'x'));
+
+        big.insert("c");
+        big.undo();
+        REQUIRE(big.undo());
+        REQUIRE(big.to_str() == std::string(100, 'x'));
+        REQUIRE_FALSE(big.can_undo());
+
+        REQUIRE(big.redo());
+        REQUIRE(big.to_str() == "a" + std::string(49, 'x') + "b" + std::string(48, 'x'));
+    }
+
+    SECTION("The journal is bounded") {
+        buf.enable_undo(16);
+        buf.move_gap_to(buf.size());
+        for (int i = 0; i < 100; i++) {
+            buf.insert("ab");
+            buf.undo_boundary();
+        }
+
+        std::size_t steps = 0;
+        while (buf.undo()) {
+            steps++;
+        }
+        REQUIRE(steps > 0);
+        REQUIRE(steps <= 8);
+        REQUIRE(buf.size() == 11 + 2 * (100 - steps));
+    }
+
+    SECTION("Clear forgets every step") {
+        buf.insert("a");
+        buf.clear();
+        REQUIRE_FALSE(buf.can_undo());
+    }
+
+    SECTION("Copies keep the journal") {
+        buf.insert("a");
+        auto copy = buf;
+        copy.undo();
+        REQUIRE(copy.to_str() == "hello world");
+        REQUIRE(buf.to_str() == "ahello world");
+    }
+
+    SECTION("Undoing and redoing random edits") {
+        buf.enable_line_index();
+        std::mt19937 rng(21);
+        std::vector<std::string> history = {buf.to_str()};
+
+        for (int i = 0; i < 300; i++) {
+            const std::size_t pos = rng() % (buf.size() + 1);
+            buf.move_gap_to(pos);
+            if (rng() % 3 == 0 && pos > 0) {
+                buf.erase(1 + rng() % pos);
+            } else {
+                buf.insert(std::string(1 + rng() % 5, "ab\ncd"[rng() % 5]));
+            }
+            buf.undo_boundary();
+            history.push_back(buf.to_str());
+        }
+
+        for (auto it = history.rbegin() + 1; it != history.rend(); ++it) {
+            REQUIRE(buf.undo());
+            REQUIRE(buf.to_str() == *it);
+        }
+        REQUIRE_FALSE(buf.undo());
+        REQUIRE(buf.line_count() == Gapbuffer(history.front()).line_count());
+
+        for (auto it = history.begin() + 1; it != history.end(); ++it) {
+            REQUIRE(buf.redo());
+            REQUIRE(buf.to_str() == *it);
+        }
+        REQUIRE(buf.line_count() == Gapbuffer(history.back()).line_count());
+        REQUIRE(buf.line_start(buf.line_count() - 1) ==
+                Gapbuffer(history.back()).line_start(buf.line_count() - 1));
+    }
+}
+
+TEST_CASE("Snapshot", "[Modifiers]") {
+    const std::string s(100, 'x');
+    auto buf = Gapbuffer(s);
+    buf.move_gap_to(50);
+
+    SECTION("Shares the storage") {
+        const auto snap = buf.snapshot();
+        REQUIRE(snap.to_str() == s);
+        REQUIRE(buf.is_shared());
+        REQUIRE(snap.segments().first.data() == buf.segments().first.data());
+    }
+
+    SECTION("Typing at the gap does not copy") {
+        buf.reserve(200);
+        const auto snap = buf.snapshot();
+        const char* storage = buf.segments().first.data();
+        for (int i = 0; i < 10; i++) {
+            buf.push_back('a');
+        }
+        buf.pop_back();
+        buf.push_back('b');
+
+        REQUIRE(buf.is_shared());
+        REQUIRE(buf.segments().first.data() == storage);
+        REQUIRE(buf.to_str() == s.substr(0, 50) + "aaaaaaaaab" + s.substr(50));
+        REQUIRE(snap.to_str() == s);
+    }
+
+    SECTION("Overwriting what the snapshot sees copies") {
+        const auto snap = buf.snapshot();
+        buf.erase(5);
+        buf.insert("abcde");
+        REQUIRE_FALSE(buf.is_shared());
+        REQUIRE(buf.to_str() == s.substr(0, 45) + "abcde" + s.substr(50));
+        REQUIRE(snap.to_str() == s);
+
+        const auto moved = buf.snapshot();
+        buf.move_gap_to(0);
+        REQUIRE_FALSE(buf.is_shared());
+        REQUIRE(moved.to_str() == s.substr(0, 45) + "abcde" + s.substr(50));
+    }
+
+    SECTION("Storage is taken back once the snapshots are gone") {
+        const char* storage = buf.segments().first.data();
+        {
+            const auto snap = buf.snapshot();
+        }
+        REQUIRE(buf.is_shared());
+        buf.move_gap_to(0);
+        REQUIRE_FALSE(buf.is_shared());
+        REQUIRE(buf.segments().second.data() - (buf.capacity() - buf.size()) == storage);
+    }
+
+    SECTION("Versions") {
+        auto first = buf.snapshot();
+        buf.insert("one");
+        auto second = buf.snapshot();
+        buf.insert("two");
+        buf.move_gap_to(buf.size());
+        buf.insert("three");
+
+        REQUIRE(first.to_str() == s);
+        REQUIRE(second.to_str() == s.substr(0, 50) + "one" + s.substr(50));
+        REQUIRE(buf.to_str() == s.substr(0, 50) + "onetwo" + s.substr(50) + "three");
+
+        // Snapshots are buffers of their own, editing one copies it
+        first.insert("!");
+        REQUIRE(first.to_str() == s.substr(0, 50) + "!" + s.substr(50));
+        REQUIRE(second.to_str() == s.substr(0, 50) + "one" + s.substr(50));
+    }
+
+    SECTION("Small buffers are copied") {
+        auto small = Gapbuffer("hello");
+        const auto snap = small.snapshot();
+        small.move_gap_to(0);
+        small.insert(">");
+        REQUIRE_FALSE(small.is_shared());
+        REQUIRE(snap.to_str() == "hello");
+    }
+
+    SECTION("Clear") {
+        const auto snap = buf.snapshot();
+        buf.clear();
+        REQUIRE(buf.empty());
+        REQUIRE_FALSE(buf.is_shared());
+        REQUIRE(snap.to_str() == s);
+    }
+
+    SECTION("The line index comes along") {
+        auto lines = Gapbuffer("one\ntwo\nthree\nfour\nfive\nsix\nseven\n");
+        lines.enable_line_index();
+        lines.enable_undo();
+        const auto snap = lines.snapshot();
+        REQUIRE(snap.has_line_index());
+        REQUIRE_FALSE(snap.has_undo());
+        REQUIRE(snap.line_start(6) == 28);
+    }
+
+    SECTION("Read from another thread while editing") {
+        std::string big;
+        for (int i = 0; i < 2000; i++) {
+            big += "line " + std::to_string(i) + "\n";
+        }
+        auto text = Gapbuffer(big);
+        text.move_gap_to(big.size() / 2);
+
+        auto snap = text.snapshot();
+        std::size_t newlines = 0;
+        std::string seen;
+        std::thread reader([&, snap = std::move(snap)] {
+            for (int i = 0; i < 20; i++) {
+                newlines = snap.count('\n');
+                seen = snap.to_str();
+            }
+        });
+        for (int i = 0; i < 1000; i++) {
+            text.push_back('a' + i % 26);
+        }
+        text.move_gap_to(0);
+        text.insert("start\n");
+        reader.join();
+
+        REQUIRE(newlines == 2000);
+        REQUIRE(seen == big);
+        REQUIRE(text.size() == big.size() + 1006);
+    }
+}